@@ -0,0 +1,301 @@
+// Copyright 2017 David Finkel
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "ignore.h"
+#include "strings.h"
+
+#include <fnmatch.h>
+
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace spin_2_fs {
+
+namespace {
+
+// A pattern matching a single path component. Common shapes are matched without fnmatch(3).
+struct Glob {
+  enum class Kind {
+    kLiteral,    // "foo"
+    kPrefix,     // "foo*"
+    kSuffix,     // "*.foo"
+    kAny,        // "*"
+    kRecursive,  // "**", which matches any number of components.
+    kPattern,    // anything else, matched with fnmatch(3).
+  };
+  Kind kind;
+  // The pattern without its '*' for kPrefix and kSuffix, or the whole pattern for kPattern.
+  std::string text;
+};
+
+struct Rule {
+  bool negated = false;
+  bool dir_only = false;
+  // Matches only the last component of a path, at any depth below the rules' directory.
+  bool basename = false;
+  std::vector<Glob> globs;
+};
+
+bool HasSuffix(const std::string &s, const std::string &suffix) {
+  return s.size() >= suffix.size() &&
+         s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+Glob CompileGlob(std::string_view pattern) {
+  if (pattern == "**") {
+    return Glob{Glob::Kind::kRecursive, std::string()};
+  }
+  if (pattern == "*") {
+    return Glob{Glob::Kind::kAny, std::string()};
+  }
+  const size_t meta = pattern.find_first_of("*?[\\");
+  if (meta == std::string_view::npos) {
+    return Glob{Glob::Kind::kLiteral, std::string(pattern)};
+  }
+  if (meta == 0 && pattern[0] == '*' &&
+      pattern.find_first_of("*?[\\", 1) == std::string_view::npos) {
+    return Glob{Glob::Kind::kSuffix, std::string(pattern.substr(1))};
+  }
+  if (meta == pattern.size() - 1 && pattern.back() == '*') {
+    return Glob{Glob::Kind::kPrefix, std::string(pattern.substr(0, meta))};
+  }
+  return Glob{Glob::Kind::kPattern, std::string(pattern)};
+}
+
+bool MatchGlob(const Glob &glob, const std::string &name) {
+  switch (glob.kind) {
+    case Glob::Kind::kLiteral:
+      return name == glob.text;
+    case Glob::Kind::kPrefix:
+      return name.compare(0, glob.text.size(), glob.text) == 0;
+    case Glob::Kind::kSuffix:
+      return HasSuffix(name, glob.text);
+    case Glob::Kind::kAny:
+    case Glob::Kind::kRecursive:
+      return true;
+    case Glob::Kind::kPattern:
+      return fnmatch(glob.text.c_str(), name.c_str(), 0) == 0;
+  }
+  return false;
+}
+
+// Matches globs[g...] against components [c, path.num_components()) of path.
+bool MatchGlobs(const std::vector<Glob> &globs, size_t g, const Path &path, int64_t c) {
+  const int64_t n = path.num_components();
+  for (; g < globs.size(); g++, c++) {
+    if (globs[g].kind == Glob::Kind::kRecursive) {
+      // A trailing "**" matches everything inside, but not the directory itself.
+      if (g + 1 == globs.size()) {
+        return c < n;
+      }
+      for (int64_t skip = c; skip < n; skip++) {
+        if (MatchGlobs(globs, g + 1, path, skip)) {
+          return true;
+        }
+      }
+      return false;
+    }
+    if (c == n || !MatchGlob(globs[g], path.component(c))) {
+      return false;
+    }
+  }
+  return c == n;
+}
+
+std::optional<Rule> ParseRule(std::string_view line) {
+  if (!line.empty() && line.back() == '\r') {
+    line.remove_suffix(1);
+  }
+  // Trailing spaces are dropped unless escaped.
+  while (!line.empty() && line.back() == ' ' &&
+         !(line.size() >= 2 && line[line.size() - 2] == '\\')) {
+    line.remove_suffix(1);
+  }
+  if (line.empty() || line.front() == '#') {
+    return std::nullopt;
+  }
+  Rule rule;
+  if (line.front() == '!') {
+    rule.negated = true;
+    line.remove_prefix(1);
+  } else if (line.size() >= 2 && line[0] == '\\' && (line[1] == '!' || line[1] == '#')) {
+    line.remove_prefix(1);
+  }
+  if (!line.empty() && line.back() == '/') {
+    rule.dir_only = true;
+    line.remove_suffix(1);
+  }
+  rule.basename = line.find('/') == std::string_view::npos;
+  if (!line.empty() && line.front() == '/') {
+    line.remove_prefix(1);
+  }
+  for (const std::string &component : SplitStrings(line, '/')) {
+    if (!component.empty()) {
+      rule.globs.push_back(CompileGlob(component));
+    }
+  }
+  if (rule.globs.empty()) {
+    return std::nullopt;
+  }
+  return rule;
+}
+
+enum class Verdict { kNoMatch, kIgnored, kIncluded };
+
+// Highest indices of the rules sharing a lookup key, split by whether directory-only rules count.
+struct Hits {
+  int file = -1;
+  int dir = -1;
+};
+
+}  // anonymous namespace
+
+struct IgnoreMatcher::Layer {
+  Path dir;
+  std::shared_ptr<const Layer> parent;
+  std::vector<Rule> rules;
+  // Basename rules that are a single literal, keyed by that literal.
+  std::unordered_map<std::string_view, Hits> names;
+  // Basename rules of the form "*.ext", keyed by ".ext".
+  std::unordered_map<std::string_view, Hits> extensions;
+  // The indices of all other rules, in increasing order.
+  std::vector<int> generic;
+
+  explicit Layer(const Path &d) : dir(d) {}
+
+  // Builds the lookup tables. Must be called once rules is complete, as the keys point into it.
+  void Index() {
+    for (int i = 0; i < static_cast<int>(rules.size()); i++) {
+      const Rule &rule = rules[i];
+      Hits *hits = nullptr;
+      if (rule.basename && rule.globs[0].kind == Glob::Kind::kLiteral) {
+        hits = &names[rule.globs[0].text];
+      } else if (rule.basename && rule.globs[0].kind == Glob::Kind::kSuffix &&
+                 rule.globs[0].text.size() > 1 && rule.globs[0].text.front() == '.') {
+        hits = &extensions[rule.globs[0].text];
+      } else {
+        generic.push_back(i);
+        continue;
+      }
+      hits->dir = i;
+      if (!rule.dir_only) {
+        hits->file = i;
+      }
+    }
+  }
+
+  bool Matches(const Rule &rule, const Path &path) const {
+    if (rule.basename) {
+      return MatchGlob(rule.globs[0], path.component(path.num_components() - 1));
+    }
+    return MatchGlobs(rule.globs, 0, path, dir.num_components());
+  }
+
+  // Finds the last rule matching path, which must be below dir.
+  Verdict Evaluate(const Path &path, bool is_dir) const {
+    const std::string &name = path.component(path.num_components() - 1);
+    int best = -1;
+    auto consider = [&best, is_dir](const std::unordered_map<std::string_view, Hits> &table,
+                                    std::string_view key) {
+      const auto it = table.find(key);
+      if (it != table.end()) {
+        best = std::max(best, is_dir ? it->second.dir : it->second.file);
+      }
+    };
+    if (!names.empty()) {
+      consider(names, name);
+    }
+    if (!extensions.empty()) {
+      for (size_t dot = name.find('.'); dot != std::string::npos; dot = name.find('.', dot + 1)) {
+        consider(extensions, std::string_view(name).substr(dot));
+      }
+    }
+    // Only rules after the best indexed match can override it.
+    for (auto it = generic.rbegin(); it != generic.rend() && *it > best; ++it) {
+      const Rule &rule = rules[*it];
+      if ((!rule.dir_only || is_dir) && Matches(rule, path)) {
+        best = *it;
+        break;
+      }
+    }
+    if (best < 0) {
+      return Verdict::kNoMatch;
+    }
+    return rules[best].negated ? Verdict::kIncluded : Verdict::kIgnored;
+  }
+};
+
+IgnoreMatcher IgnoreMatcher::WithRules(const Path &dir, std::string_view contents) const {
+  auto layer = std::make_shared<Layer>(dir);
+  layer->parent = layer_;
+  while (!contents.empty()) {
+    const size_t eol = contents.find('\n');
+    if (std::optional<Rule> rule = ParseRule(contents.substr(0, eol))) {
+      layer->rules.push_back(std::move(*rule));
+    }
+    if (eol == std::string_view::npos) {
+      break;
+    }
+    contents.remove_prefix(eol + 1);
+  }
+  if (layer->rules.empty()) {
+    return *this;
+  }
+  layer->Index();
+  return IgnoreMatcher(std::move(layer));
+}
+
+bool IgnoreMatcher::IsIgnored(const Path &path, bool is_dir) const {
+  for (const Layer *layer = layer_.get(); layer != nullptr; layer = layer->parent.get()) {
+    if (!path.has_parent(layer->dir)) {
+      continue;
+    }
+    switch (layer->Evaluate(path, is_dir)) {
+      case Verdict::kIgnored:
+        return true;
+      case Verdict::kIncluded:
+        return false;
+      case Verdict::kNoMatch:
+        break;
+    }
+  }
+  return false;
+}
+
+size_t IgnoreMatcher::num_rules() const {
+  size_t n = 0;
+  for (const Layer *layer = layer_.get(); layer != nullptr; layer = layer->parent.get()) {
+    n += layer->rules.size();
+  }
+  return n;
+}
+
+}  // namespace spin_2_fs
+// vim: sw=2:sts=2:tw=100:et:cindent:cinoptions=l1,g1,h1,N-s,E-s,i2s,+2s,(0,w1,W2s
@@ -0,0 +1,79 @@
+// Copyright 2017 David Finkel
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef include_spin_2_fs_ignore_h
+#define include_spin_2_fs_ignore_h
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+
+#include "path.h"
+
+namespace spin_2_fs {
+
+// IgnoreMatcher evaluates layered gitignore-style rules against Paths.
+//
+// Each layer holds the compiled rules of one ignore file, anchored at the directory containing it,
+// and refers to the layer it was added on top of. Layers are immutable and shared, so a walker can
+// keep one matcher per directory on its stack at the cost of a refcount, much like Path::parent().
+//
+// Supported syntax follows gitignore(5): blank lines and lines starting with '#' are skipped, a
+// leading '!' re-includes what an earlier rule ignored, a trailing '/' matches only directories,
+// a pattern containing any other '/' is matched against the path relative to the rules' directory
+// (otherwise against the last component at any depth), and "*", "?", "[...]" and "**" have their
+// usual meanings. The last matching rule wins, and rules in later layers take precedence.
+class IgnoreMatcher {
+ public:
+  // A matcher with no rules, which ignores nothing.
+  IgnoreMatcher() = default;
+
+  // Returns a matcher with the rules parsed from contents, the text of an ignore file in dir,
+  // layered on top of this matcher's rules. This matcher is unchanged.
+  IgnoreMatcher WithRules(const Path &dir, std::string_view contents) const;
+
+  // Returns true if path is ignored. is_dir determines whether directory-only rules apply.
+  //
+  // As in git, nothing below an ignored directory can be re-included, so a walker should not
+  // descend into a directory for which this returns true. Only the rules matching path itself are
+  // considered; whether one of its parents is ignored is not checked.
+  bool IsIgnored(const Path &path, bool is_dir) const;
+
+  // Total number of rules in all layers.
+  size_t num_rules() const;
+
+ private:
+  struct Layer;
+  explicit IgnoreMatcher(std::shared_ptr<const Layer> layer) : layer_(std::move(layer)) {}
+
+  std::shared_ptr<const Layer> layer_;
+};
+
+}  // namespace spin_2_fs
+
+#endif  // include_spin_2_fs_ignore_h
+// vim: sw=2:sts=2:tw=100:et:cindent:cinoptions=l1,g1,h1,N-s,E-s,i2s,+2s,(0,w1,W2s
@@ -0,0 +1,354 @@
+// Copyright 2017 David Finkel
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <fnmatch.h>
+
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "ignore.h"
+
+namespace spin_2_fs {
+namespace {
+
+// A root ignore file shaped like a typical polyglot repository's: the union of the common
+// github/gitignore templates for C/C++, Python, Node, Java, editors and operating systems.
+constexpr char kRootRules[] = R"(# Prerequisites
+*.d
+# Object files
+*.o
+*.ko
+*.obj
+*.elf
+*.ilk
+*.map
+*.exp
+*.gch
+*.pch
+*.lib
+*.a
+*.la
+*.lo
+*.dll
+*.so
+*.so.*
+*.dylib
+*.exe
+*.out
+*.app
+*.i*86
+*.x86_64
+*.hex
+*.dSYM/
+*.su
+*.idb
+*.pdb
+*.mod*
+*.cmd
+.tmp_versions/
+modules.order
+Module.symvers
+Mkfile.old
+dkms.conf
+# Python
+__pycache__/
+*.py[cod]
+*$py.class
+.Python
+/build/
+develop-eggs/
+/dist/
+downloads/
+eggs/
+.eggs/
+/lib/
+/lib64/
+parts/
+sdist/
+var/
+wheels/
+*.egg-info/
+.installed.cfg
+*.egg
+MANIFEST
+pip-log.txt
+pip-delete-this-directory.txt
+htmlcov/
+.tox/
+.nox/
+.coverage
+.coverage.*
+.cache
+nosetests.xml
+coverage.xml
+*.cover
+.hypothesis/
+.pytest_cache/
+*.mo
+*.pot
+local_settings.py
+db.sqlite3
+instance/
+.webassets-cache
+.scrapy
+docs/_build/
+target/
+.ipynb_checkpoints
+.python-version
+celerybeat-schedule
+*.sage.py
+.env
+.venv
+env/
+venv/
+ENV/
+.spyderproject
+.ropeproject
+/site
+.mypy_cache/
+# Node
+logs
+*.log
+npm-debug.log*
+yarn-debug.log*
+yarn-error.log*
+pids
+*.pid
+*.seed
+*.pid.lock
+lib-cov
+coverage
+.nyc_output
+.grunt
+bower_components
+.lock-wscript
+build/Release
+node_modules/
+jspm_packages/
+typings/
+.npm
+.eslintcache
+.node_repl_history
+*.tgz
+.yarn-integrity
+.next
+# Java
+*.class
+*.jar
+*.war
+*.nar
+*.ear
+*.zip
+*.tar.gz
+*.rar
+hs_err_pid*
+.gradle
+**/build/generated/
+!gradle-wrapper.jar
+# Editors
+.idea/
+*.iml
+*.swp
+*.swo
+*~
+\#*\#
+.\#*
+.vscode/*
+!.vscode/settings.json
+!.vscode/tasks.json
+# OS
+.DS_Store
+.AppleDouble
+.LSOverride
+._*
+Thumbs.db
+ehthumbs.db
+Desktop.ini
+$RECYCLE.BIN/
+)";
+
+constexpr char kSubdirRules[] = R"(!*.log
+generated/
+/tmp
+**/fixtures/*.bin
+)";
+
+struct Entry {
+  Path path;
+  std::string relative;
+  bool is_dir;
+};
+
+// Builds a repository-shaped list of entries below root.
+std::vector<Entry> MakeEntries(const std::string &root) {
+  static const char *const kDirs[] = {"src",  "lib",   "node_modules", "build", "docs",
+                                      "test", ".idea", "__pycache__",  "logs",  "tools"};
+  static const char *const kFiles[] = {"main.cc", "util.h",     "util.o",    "index.js",
+                                       "app.py",  "app.pyc",    "README.md", "debug.log",
+                                       "a.jar",   "config.yml", "x.swp",     "Makefile"};
+  std::vector<Entry> entries;
+  auto add = [&entries, &root](const std::string &rel, bool is_dir) {
+    entries.push_back(Entry{Path(root + "/" + rel), rel, is_dir});
+  };
+  for (const char *top : kDirs) {
+    add(top, true);
+    for (int sub = 0; sub < 20; sub++) {
+      const std::string dir = std::string(top) + "/pkg" + std::to_string(sub);
+      add(dir, true);
+      for (const char *file : kFiles) {
+        add(dir + "/" + file, false);
+        add(dir + "/nested/deeper/" + file, false);
+      }
+    }
+  }
+  return entries;
+}
+
+// The approach the matcher replaces: every rule is a string pattern matched with fnmatch(3)
+// against the relative path (or its basename), with the last match winning.
+class NaiveRules {
+ public:
+  explicit NaiveRules(std::string_view contents) {
+    while (!contents.empty()) {
+      const size_t eol = contents.find('\n');
+      std::string line(contents.substr(0, eol));
+      contents.remove_prefix(eol == std::string_view::npos ? contents.size() : eol + 1);
+      if (line.empty() || line[0] == '#') {
+        continue;
+      }
+      Rule rule;
+      if (line[0] == '!') {
+        rule.negated = true;
+        line.erase(0, 1);
+      }
+      if (line.back() == '/') {
+        rule.dir_only = true;
+        line.pop_back();
+      }
+      rule.basename = line.find('/') == std::string::npos;
+      if (line[0] == '/') {
+        line.erase(0, 1);
+      }
+      rule.pattern = line;
+      rules_.push_back(rule);
+    }
+  }
+
+  bool IsIgnored(const std::string &relative, bool is_dir) const {
+    const size_t slash = relative.rfind('/');
+    const char *basename = relative.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+    bool ignored = false;
+    for (const Rule &rule : rules_) {
+      if (rule.dir_only && !is_dir) {
+        continue;
+      }
+      const char *subject = rule.basename ? basename : relative.c_str();
+      if (fnmatch(rule.pattern.c_str(), subject, FNM_PATHNAME) == 0) {
+        ignored = !rule.negated;
+      }
+    }
+    return ignored;
+  }
+
+ private:
+  struct Rule {
+    bool negated = false;
+    bool dir_only = false;
+    bool basename = false;
+    std::string pattern;
+  };
+  std::vector<Rule> rules_;
+};
+
+void BM_IgnoreMatcher(benchmark::State &state) {
+  const IgnoreMatcher matcher = IgnoreMatcher().WithRules(Path("/repo"), kRootRules);
+  const std::vector<Entry> entries = MakeEntries("/repo");
+  for (auto _ : state) {
+    for (const Entry &e : entries) {
+      benchmark::DoNotOptimize(matcher.IsIgnored(e.path, e.is_dir));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * entries.size());
+}
+BENCHMARK(BM_IgnoreMatcher);
+
+void BM_IgnoreMatcherLayered(benchmark::State &state) {
+  const IgnoreMatcher matcher = IgnoreMatcher()
+                                    .WithRules(Path("/repo"), kRootRules)
+                                    .WithRules(Path("/repo/src"), kSubdirRules)
+                                    .WithRules(Path("/repo/src/pkg3"), kSubdirRules);
+  const std::vector<Entry> entries = MakeEntries("/repo");
+  for (auto _ : state) {
+    for (const Entry &e : entries) {
+      benchmark::DoNotOptimize(matcher.IsIgnored(e.path, e.is_dir));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * entries.size());
+}
+BENCHMARK(BM_IgnoreMatcherLayered);
+
+void BM_NaiveFnmatch(benchmark::State &state) {
+  const NaiveRules rules(kRootRules);
+  const std::vector<Entry> entries = MakeEntries("/repo");
+  for (auto _ : state) {
+    for (const Entry &e : entries) {
+      benchmark::DoNotOptimize(rules.IsIgnored(e.relative, e.is_dir));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * entries.size());
+}
+BENCHMARK(BM_NaiveFnmatch);
+
+// Walks the entries in order, skipping everything below an ignored directory as a pruning walker
+// would.
+void BM_PrunedWalk(benchmark::State &state) {
+  const IgnoreMatcher matcher = IgnoreMatcher().WithRules(Path("/repo"), kRootRules);
+  const std::vector<Entry> entries = MakeEntries("/repo");
+  int64_t checked = 0;
+  for (auto _ : state) {
+    for (size_t i = 0; i < entries.size(); i++) {
+      checked++;
+      if (entries[i].is_dir && matcher.IsIgnored(entries[i].path, true)) {
+        const Path &pruned = entries[i].path;
+        while (i + 1 < entries.size() && entries[i + 1].path.has_parent(pruned)) {
+          i++;
+        }
+      } else if (!entries[i].is_dir) {
+        benchmark::DoNotOptimize(matcher.IsIgnored(entries[i].path, false));
+      }
+    }
+  }
+  state.SetItemsProcessed(checked);
+}
+BENCHMARK(BM_PrunedWalk);
+
+}  // anonymous namespace
+}  // namespace spin_2_fs
+
+BENCHMARK_MAIN();
+// vim: sw=2:sts=2:tw=100:et:cindent:cinoptions=l1,g1,h1,N-s,E-s,i2s,+2s,(0,w1,W2s
@@ -0,0 +1,145 @@
+// Copyright 2017 David Finkel
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "ignore.h"
+
+namespace spin_2_fs {
+namespace {
+
+bool File(const IgnoreMatcher &m, const std::string &path) {
+  return m.IsIgnored(Path(path), false);
+}
+bool Dir(const IgnoreMatcher &m, const std::string &path) { return m.IsIgnored(Path(path), true); }
+
+TEST(TestIgnore, Empty) {
+  const IgnoreMatcher m;
+  EXPECT_FALSE(File(m, "/repo/foo"));
+  EXPECT_EQ(0u, m.num_rules());
+  const IgnoreMatcher comments = m.WithRules(Path("/repo"), "# comment\n\n   \n");
+  EXPECT_EQ(0u, comments.num_rules());
+}
+
+TEST(TestIgnore, Basenames) {
+  const IgnoreMatcher m = IgnoreMatcher().WithRules(Path("/repo"), "*.o\nbuild\nfoo*\n*~\n");
+  EXPECT_EQ(4u, m.num_rules());
+  EXPECT_TRUE(File(m, "/repo/a.o"));
+  EXPECT_TRUE(File(m, "/repo/src/deep/a.o"));
+  EXPECT_FALSE(File(m, "/repo/a.oo"));
+  EXPECT_FALSE(File(m, "/repo/a.o/b"));
+  EXPECT_TRUE(Dir(m, "/repo/sub/build"));
+  EXPECT_TRUE(File(m, "/repo/foobar"));
+  EXPECT_TRUE(File(m, "/repo/x.c~"));
+  EXPECT_FALSE(File(m, "/repo/barfoo"));
+  // Rules only apply below their directory.
+  EXPECT_FALSE(File(m, "/other/a.o"));
+  EXPECT_FALSE(Dir(m, "/repo"));
+  EXPECT_FALSE(File(m, "repo/a.o"));
+}
+
+TEST(TestIgnore, Anchored) {
+  const IgnoreMatcher m =
+      IgnoreMatcher().WithRules(Path("/repo"), "/TODO\ndoc/*.txt\nlib/**/gen\n**/logs\nout/**\n");
+  EXPECT_TRUE(File(m, "/repo/TODO"));
+  EXPECT_FALSE(File(m, "/repo/sub/TODO"));
+  EXPECT_TRUE(File(m, "/repo/doc/a.txt"));
+  EXPECT_FALSE(File(m, "/repo/doc/sub/a.txt"));
+  EXPECT_FALSE(File(m, "/repo/x/doc/a.txt"));
+  EXPECT_TRUE(Dir(m, "/repo/lib/gen"));
+  EXPECT_TRUE(Dir(m, "/repo/lib/a/b/gen"));
+  EXPECT_FALSE(Dir(m, "/repo/gen"));
+  EXPECT_TRUE(Dir(m, "/repo/logs"));
+  EXPECT_TRUE(Dir(m, "/repo/a/b/logs"));
+  EXPECT_FALSE(Dir(m, "/repo/out"));
+  EXPECT_TRUE(File(m, "/repo/out/a"));
+  EXPECT_TRUE(File(m, "/repo/out/a/b"));
+}
+
+TEST(TestIgnore, Patterns) {
+  const IgnoreMatcher m = IgnoreMatcher().WithRules(Path("/r"), "file?.[ch]\n*.tar.*\n\\#hash\n");
+  EXPECT_TRUE(File(m, "/r/file1.c"));
+  EXPECT_TRUE(File(m, "/r/fileX.h"));
+  EXPECT_FALSE(File(m, "/r/file12.c"));
+  EXPECT_TRUE(File(m, "/r/a.tar.gz"));
+  EXPECT_TRUE(File(m, "/r/#hash"));
+}
+
+TEST(TestIgnore, DirectoryOnly) {
+  const IgnoreMatcher m = IgnoreMatcher().WithRules(Path("/r"), "cache/\n/top/sub/\n");
+  EXPECT_TRUE(Dir(m, "/r/cache"));
+  EXPECT_TRUE(Dir(m, "/r/a/cache"));
+  EXPECT_FALSE(File(m, "/r/cache"));
+  EXPECT_TRUE(Dir(m, "/r/top/sub"));
+  EXPECT_FALSE(File(m, "/r/top/sub"));
+}
+
+TEST(TestIgnore, NegationLastMatchWins) {
+  const IgnoreMatcher m = IgnoreMatcher().WithRules(
+      Path("/r"), "*.log\n!important.log\n*.tmp\n!keep/*.tmp\nkeep/x.tmp\n");
+  EXPECT_TRUE(File(m, "/r/a.log"));
+  EXPECT_FALSE(File(m, "/r/important.log"));
+  EXPECT_FALSE(File(m, "/r/sub/important.log"));
+  EXPECT_TRUE(File(m, "/r/a.tmp"));
+  EXPECT_FALSE(File(m, "/r/keep/a.tmp"));
+  EXPECT_TRUE(File(m, "/r/keep/x.tmp"));
+
+  // A later literal rule beats an earlier negated pattern and vice versa.
+  const IgnoreMatcher order = IgnoreMatcher().WithRules(Path("/r"), "!*.c\nmain.c\n");
+  EXPECT_TRUE(File(order, "/r/main.c"));
+  const IgnoreMatcher reverse = IgnoreMatcher().WithRules(Path("/r"), "main.c\n!*.c\n");
+  EXPECT_FALSE(File(reverse, "/r/main.c"));
+}
+
+TEST(TestIgnore, Layers) {
+  const IgnoreMatcher root = IgnoreMatcher().WithRules(Path("/r"), "*.log\nbuild/\n");
+  const IgnoreMatcher sub = root.WithRules(Path("/r/sub"), "!debug.log\n/local\n");
+  EXPECT_EQ(2u, root.num_rules());
+  EXPECT_EQ(4u, sub.num_rules());
+  // The deeper layer overrides its parent, but only below its own directory.
+  EXPECT_FALSE(File(sub, "/r/sub/debug.log"));
+  EXPECT_FALSE(File(sub, "/r/sub/x/debug.log"));
+  EXPECT_TRUE(File(sub, "/r/debug.log"));
+  EXPECT_TRUE(File(sub, "/r/sub/other.log"));
+  EXPECT_TRUE(Dir(sub, "/r/sub/build"));
+  EXPECT_TRUE(File(sub, "/r/sub/local"));
+  EXPECT_FALSE(File(sub, "/r/local"));
+  // The parent matcher is unaffected.
+  EXPECT_TRUE(File(root, "/r/sub/debug.log"));
+}
+
+TEST(TestIgnore, TrailingSpaces) {
+  const IgnoreMatcher m = IgnoreMatcher().WithRules(Path("/r"), "foo  \r\nbar\\ \n");
+  EXPECT_TRUE(File(m, "/r/foo"));
+  EXPECT_TRUE(File(m, "/r/bar "));
+  EXPECT_FALSE(File(m, "/r/bar"));
+}
+
+}  // anonymous namespace
+}  // namespace spin_2_fs
+// vim: sw=2:sts=2:tw=100:et:cindent:cinoptions=l1,g1,h1,N-s,E-s,i2s,+2s,(0,w1,W2s
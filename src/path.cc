@@ -26,16 +26,19 @@
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "path.h"
+#include "path_stats.h"
 #include "strings.h"
 
 #include <unistd.h>
 
+#include <cstdlib>
+
 namespace spin_2_fs {
 using namespace std::string_literals;
 
 namespace {
 
-bool IsAbsolute(const std::string &path) {
+bool IsAbsolute(std::string_view path) {
   if (path.empty()) {
     return false;
   }
@@ -45,7 +48,7 @@ bool IsAbsolute(const std::string &path) {
   return false;
 }
 
-bool IsDirectory(const std::string &path) {
+bool IsDirectory(std::string_view path) {
   if (path.empty()) {
     return false;
   }
@@ -65,6 +68,7 @@ void StripEmptyPrefixes(std::vector<std::string> *components, const bool absolut
   }
 }
 std::vector<std::string> CanonicalizePath(std::vector<std::string> components, bool absolute) {
+  SPIN_2_FS_PATH_OP_TIMER(PathOp::kCanonicalize);
   StripEmptyPrefixes(&components, absolute);
   // Keep track of how far we are into a prefix of non-".." components so far,
   // to handle a "../.." prefix correctly in relative paths.
@@ -104,31 +108,50 @@ std::vector<std::string> CanonicalizePath(std::vector<std::string> components, b
   return components;
 }
 
-std::vector<std::string> CanonicalizePath(const std::string &path) {
+std::vector<std::string> CanonicalizePath(std::string_view path) {
   std::vector<std::string> components = SplitStrings(path, '/');
   const bool absolute = IsAbsolute(path);
-  return CanonicalizePath(components, absolute);
+  return CanonicalizePath(std::move(components), absolute);
+}
+
+// Parses and canonicalizes path into freshly allocated component storage.
+template <typename RefCount>
+path_internal::ComponentsPtr<RefCount> ParseComponents(std::string_view path) {
+  SPIN_2_FS_PATH_OP_TIMER(PathOp::kConstruct);
+  path_internal::ComponentsPtr<RefCount> components(CanonicalizePath(path));
+  SPIN_2_FS_PATH_RECORD_STORAGE(*components);
+  return components;
 }
 
 }  // anonymous namespace
 
-Path::Path(const std::string &path)
-    : components_(std::make_shared<std::vector<std::string>>(CanonicalizePath(path))),
+template <typename RefCount>
+BasicPath<RefCount>::BasicPath(std::string_view path)
+    : components_(ParseComponents<RefCount>(path)),
       absolute_(IsAbsolute(path)),
       directory_(IsDirectory(path)),
       num_components_(components_->size()) {}
 
-Path::Path(std::vector<std::string> path, bool abs, bool dir)
-    : components_(std::make_shared<std::vector<std::string>>(std::move(path))),
+template <typename RefCount>
+BasicPath<RefCount>::BasicPath(std::vector<std::string> path, bool abs, bool dir)
+    : components_(std::move(path)),
       absolute_(abs),
       directory_(dir),
-      num_components_(components_->size()) {}
+      num_components_(components_->size()) {
+  SPIN_2_FS_PATH_RECORD_STORAGE(*components_);
+}
 
-Path::Path(std::shared_ptr<const std::vector<std::string>> path, bool abs, bool dir,
-           int64_t num_components)
-    : components_(path), absolute_(abs), directory_(dir), num_components_(num_components) {}
+template <typename RefCount>
+BasicPath<RefCount>::BasicPath(path_internal::ComponentsPtr<RefCount> path, bool abs, bool dir,
+                               int64_t num_components)
+    : components_(std::move(path)),
+      absolute_(abs),
+      directory_(dir),
+      num_components_(num_components) {}
 
-std::string Path::to_string() const {
+template <typename RefCount>
+std::string BasicPath<RefCount>::to_string() const {
+  SPIN_2_FS_PATH_OP_TIMER(PathOp::kToString);
   std::string canonical_path;
   int64_t done_dirs = 0;
   if (num_components_ <= 0 || components_->empty()) {
@@ -154,12 +177,15 @@ std::string Path::to_string() const {
   return canonical_path;
 }
 
-std::vector<std::string> Path::get_components() const {
+template <typename RefCount>
+std::vector<std::string> BasicPath<RefCount>::get_components() const {
   return std::vector<std::string>(components_->begin(), components_->begin() + num_components_);
 }
 
-Path Path::parent() const {
-  std::shared_ptr<const std::vector<std::string>> components = components_;
+template <typename RefCount>
+BasicPath<RefCount> BasicPath<RefCount>::parent() const {
+  SPIN_2_FS_PATH_OP_TIMER(PathOp::kParent);
+  path_internal::ComponentsPtr<RefCount> components = components_;
   int64_t new_components = std::max<int64_t>(num_components_ - 1, 0);
   // special handling for the relative case where we hit the beginning.
   if (!absolute_) {
@@ -182,16 +208,19 @@ Path Path::parent() const {
       std::vector<std::string> components_l{".."};
       components_l.reserve(1 + num_components_);
       components_l.insert(components_l.end(), components_->begin(), components_->end());
-      components = std::make_shared<const std::vector<std::string>>(std::move(components_l));
+      components = path_internal::ComponentsPtr<RefCount>(std::move(components_l));
+      SPIN_2_FS_PATH_RECORD_PARENT_REBUILD();
+      SPIN_2_FS_PATH_RECORD_STORAGE(*components);
       new_components = num_components_ + 1;
     }
   }
-  Path up(std::move(components), absolute_, /* dir = */ true,
-          /* num_components = */ new_components);
+  BasicPath up(std::move(components), absolute_, /* dir = */ true,
+               /* num_components = */ new_components);
   return up;
 }
 
-bool Path::operator<(const Path &other) const {
+template <typename RefCount>
+bool BasicPath<RefCount>::operator<(const BasicPath &other) const {
   // make relative paths sort after absolute ones.
   if (other.absolute_ != absolute_) {
     if (other.absolute_ && !absolute_) {
@@ -227,7 +256,8 @@ bool Path::operator<(const Path &other) const {
   return num_components_ < other.num_components_;
 }
 
-bool Path::has_parent(const Path &path) const {
+template <typename RefCount>
+bool BasicPath<RefCount>::has_parent(const BasicPath &path) const {
   if (absolute_ != path.absolute_) {
     return false;
   }
@@ -248,29 +278,37 @@ bool Path::has_parent(const Path &path) const {
   return path.num_components_ < num_components_;
 }
 
-Path Path::Join(const Path &suffix) const {
+template <typename RefCount>
+BasicPath<RefCount> BasicPath<RefCount>::Join(const BasicPath &suffix) const {
+  SPIN_2_FS_PATH_OP_TIMER(PathOp::kJoin);
   std::vector<std::string> new_components = get_components();
   const std::vector<std::string> suffix_elems = suffix.get_components();
   new_components.insert(new_components.end(), suffix_elems.begin(), suffix_elems.end());
 
-  return Path(CanonicalizePath(new_components, absolute_), absolute_, suffix.directory_);
+  return BasicPath(CanonicalizePath(std::move(new_components), absolute_), absolute_,
+                   suffix.directory_);
 }
 
-Path Path::Cwd() {
+template <typename RefCount>
+BasicPath<RefCount> BasicPath<RefCount>::Cwd() {
   std::string cwd;
-  cwd.assign(get_current_dir_name());
+  char *const dir_name = get_current_dir_name();
+  cwd.assign(dir_name);
+  free(dir_name);
 
-  return Path(CanonicalizePath(cwd), true, true);
+  return BasicPath(CanonicalizePath(cwd), true, true);
 }
 
-Path Path::absolute() const {
+template <typename RefCount>
+BasicPath<RefCount> BasicPath<RefCount>::absolute() const {
   if (absolute_) {
     return *this;
   }
   return Cwd() / *this;
 }
 
-bool Path::operator==(const Path &other) const {
+template <typename RefCount>
+bool BasicPath<RefCount>::operator==(const BasicPath &other) const {
   if (absolute_ != other.absolute_) {
     return false;
   }
@@ -284,7 +322,7 @@ bool Path::operator==(const Path &other) const {
     return true;
   }
   auto it = components_->begin();
-  auto oit = components_->begin();
+  auto oit = other.components_->begin();
   for (int i = 0; i < num_components_ && it != components_->end(); i++, it++, oit++) {
     if (*it == *oit) {
       continue;
@@ -294,7 +332,9 @@ bool Path::operator==(const Path &other) const {
   return true;
 }
 
-std::optional<Path> Path::make_relative(const Path &parent) const {
+template <typename RefCount>
+std::optional<BasicPath<RefCount>> BasicPath<RefCount>::make_relative(
+    const BasicPath &parent) const {
   if (!has_parent(parent)) {
     // This is not a parent, so there isn't anything we can do, just return
     // null.
@@ -305,17 +345,22 @@ std::optional<Path> Path::make_relative(const Path &parent) const {
   }
   auto first_preserved = components_->begin();
   std::advance(first_preserved, parent.num_components_);
-  std::vector<std::string> new_components(first_preserved, components_->end());
-  return Path(std::move(new_components), false, directory_);
+  std::vector<std::string> new_components(first_preserved,
+                                          components_->begin() + num_components_);
+  return BasicPath(std::move(new_components), false, directory_);
 }
 
-std::string Path::last_component() const {
+template <typename RefCount>
+std::string BasicPath<RefCount>::last_component() const {
   if (num_components_ == 0) {
     return std::string();
   }
-  return components_->back();
+  return (*components_)[num_components_ - 1];
 }
 
+template class BasicPath<AtomicRefCount>;
+template class BasicPath<LocalRefCount>;
+
 }  // namespace spin_2_fs
 
 // vim: sw=2:sts=2:tw=100:et:cindent:cinoptions=l1,g1,h1,N-s,E-s,i2s,+2s,(0,w1,W2s
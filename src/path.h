@@ -28,48 +28,117 @@
 #ifndef include_spin_2_fs_path_h
 #define include_spin_2_fs_path_h
 
+#include <atomic>
+#include <cstdint>
 #include <optional>
-
-#include <memory>
 #include <ostream>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 namespace spin_2_fs {
 
-// Path represents a filesystem path. Attempts have been made to make common operations such as
+// Reference-counting policies for BasicPath's shared component storage.
+//
+// AtomicRefCount is safe for paths that are copied or destroyed concurrently from several threads.
+struct AtomicRefCount {
+  using Counter = std::atomic<int64_t>;
+  static void Increment(Counter *c) { c->fetch_add(1, std::memory_order_relaxed); }
+  // Returns true if the last reference was dropped.
+  static bool Decrement(Counter *c) { return c->fetch_sub(1, std::memory_order_acq_rel) == 1; }
+};
+
+// LocalRefCount uses a plain integer, avoiding the cost of atomic read-modify-writes, but paths
+// using it (and every path sharing storage with them, e.g. through parent()) must stay on one
+// thread. Convert to Path to hand one to another thread.
+struct LocalRefCount {
+  using Counter = int64_t;
+  static void Increment(Counter *c) { ++*c; }
+  static bool Decrement(Counter *c) { return --*c == 0; }
+};
+
+namespace path_internal {
+
+// Intrusively reference-counted pointer to an immutable vector of path components.
+template <typename RefCount>
+class ComponentsPtr {
+ public:
+  explicit ComponentsPtr(std::vector<std::string> components)
+      : storage_(new Storage{typename RefCount::Counter{1}, std::move(components)}) {}
+  ComponentsPtr(const ComponentsPtr &other) noexcept : storage_(other.storage_) {
+    // storage_ is null after a move.
+    if (storage_ != nullptr) {
+      RefCount::Increment(&storage_->refs);
+    }
+  }
+  ComponentsPtr(ComponentsPtr &&other) noexcept : storage_(other.storage_) {
+    other.storage_ = nullptr;
+  }
+  ComponentsPtr &operator=(ComponentsPtr other) noexcept {
+    std::swap(storage_, other.storage_);
+    return *this;
+  }
+  ~ComponentsPtr() {
+    if (storage_ != nullptr && RefCount::Decrement(&storage_->refs)) {
+      delete storage_;
+    }
+  }
+
+  const std::vector<std::string> &operator*() const { return storage_->components; }
+  const std::vector<std::string> *operator->() const { return &storage_->components; }
+  bool operator==(const ComponentsPtr &other) const { return storage_ == other.storage_; }
+
+ private:
+  struct Storage {
+    typename RefCount::Counter refs;
+    const std::vector<std::string> components;
+  };
+  Storage *storage_;
+};
+
+}  // namespace path_internal
+
+// BasicPath represents a filesystem path. Attempts have been made to make common operations such as
 // fetching the parent directory cheap.
 //
 // The underlying vector containing path-components is reference-counted, so requesting the parent
-// directory involves copying 2 bools, 1 int (that gets decremented), a pointer and updating a
-// shared_ptr refcount.
-class Path {
+// directory involves copying 2 bools, 1 int (that gets decremented), a pointer and incrementing the
+// refcount. RefCount selects how that refcount is maintained; most code should use the Path alias
+// below, and LocalPath only where the atomic increments show up in profiles.
+template <typename RefCount>
+class BasicPath {
  public:
-  explicit Path(const std::string &path);
+  explicit BasicPath(std::string_view path);
   // Enable the default move and copy constructors.
-  Path(const Path &path) = default;
-  Path(Path &&path) = default;
-  Path &operator=(const Path &) = default;
-  Path &operator=(Path &&) = default;
+  BasicPath(const BasicPath &path) = default;
+  BasicPath(BasicPath &&path) = default;
+  BasicPath &operator=(const BasicPath &) = default;
+  BasicPath &operator=(BasicPath &&) = default;
+
+  // Converts between refcounting policies. This copies the components, as the two policies can't
+  // share storage.
+  template <typename OtherRefCount>
+  explicit BasicPath(const BasicPath<OtherRefCount> &other)
+      : BasicPath(other.get_components(), other.absolute_, other.directory_) {}
 
   // Raw Constructor intended for bypassing validation and string parsing.
-  Path(std::vector<std::string> path, bool abs, bool dir);
+  BasicPath(std::vector<std::string> path, bool abs, bool dir);
 
   // Get the current working directory as a Path object.
-  static Path Cwd();
+  static BasicPath Cwd();
   // Fast factory for a Path representing "/".
-  inline static Path Root() { return Path(std::vector<std::string>{}, true, true); }
+  inline static BasicPath Root() { return BasicPath(std::vector<std::string>{}, true, true); }
 
   // Since we can't add a std::string constructor for Path, we have to settle for a to_string()
   // method.
   std::string to_string() const;
 
   // returns the parent directory.
-  Path parent() const;
+  BasicPath parent() const;
   // returns true if the argument is a parent of *this (e.g. "/" is always a
   // parent of an absolute path)
-  bool has_parent(const Path &path) const;
+  bool has_parent(const BasicPath &path) const;
 
   // As the name implies, returns true iff the path is "/".
   // (useful in the termination condition for loops iterating over parent directories)
@@ -81,35 +150,43 @@ class Path {
   // Used for sorting paths. Unlike strict lexical sorting, parent paths always sort immediately
   // before children.
   // Relative paths sort after absolute ones.
-  bool operator<(const Path &other) const;
+  bool operator<(const BasicPath &other) const;
 
   // Concatenation methods.
-  Path Join(const Path &suffix) const;
-  inline Path operator/(const Path &suffix) const { return Join(suffix); }
+  BasicPath Join(const BasicPath &suffix) const;
+  inline BasicPath operator/(const BasicPath &suffix) const { return Join(suffix); }
 
-  bool operator==(const Path &other) const;
-  inline bool operator!=(const Path &other) const { return !(*this == other); }
+  bool operator==(const BasicPath &other) const;
+  inline bool operator!=(const BasicPath &other) const { return !(*this == other); }
 
   // Return a new, relative path constructed by removing a parent.
   // May return std:nullopt if the parent argument is not an actually a parent of the path
   // make_relative() is operating on.
-  std::optional<Path> make_relative(const Path &parent) const;
+  std::optional<BasicPath> make_relative(const BasicPath &parent) const;
 
   // Converts a relative path into an absolute path by applying the relative path to the CWD.
-  Path absolute() const;
+  BasicPath absolute() const;
 
   // Returns the last component of the path or an empty string if the path is empty or the root.
   std::string last_component() const;
 
+  // Returns the number of components in the path ("/" and "." have none).
+  constexpr int64_t num_components() const { return num_components_; }
+  // Returns the i'th component of the path, for 0 <= i < num_components().
+  const std::string &component(int64_t i) const { return (*components_)[i]; }
+
  private:
+  template <typename OtherRefCount>
+  friend class BasicPath;
+
   // Copies the current vector of components, trimmed down to the correct length. (used to implement
   // a number of methods)
   std::vector<std::string> get_components() const;
 
   // Internal constructor used to implement the reference-counted components.
-  Path(std::shared_ptr<const std::vector<std::string>> path, bool abs, bool dir,
-       int64_t num_components);
-  std::shared_ptr<const std::vector<std::string>> components_;
+  BasicPath(path_internal::ComponentsPtr<RefCount> path, bool abs, bool dir,
+            int64_t num_components);
+  path_internal::ComponentsPtr<RefCount> components_;
   // True if this was an absolute path.
   bool absolute_;
   // True if there was a trailing slash.
@@ -119,8 +196,17 @@ class Path {
   int64_t num_components_;
 };
 
+// Both policies are instantiated in path.cc.
+extern template class BasicPath<AtomicRefCount>;
+extern template class BasicPath<LocalRefCount>;
+
+using Path = BasicPath<AtomicRefCount>;
+// A Path that must not be shared between threads, in exchange for cheaper copies and parent().
+using LocalPath = BasicPath<LocalRefCount>;
+
 // Define an ostream operator so gtest knows how to pretty-print Paths.
-inline std::ostream &operator<<(std::ostream &stream, Path path) {
+template <typename RefCount>
+inline std::ostream &operator<<(std::ostream &stream, const BasicPath<RefCount> &path) {
   stream << path.to_string();
   return stream;
 }
@@ -0,0 +1,97 @@
+// Copyright 2017 David Finkel
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "path.h"
+
+namespace spin_2_fs {
+namespace {
+
+template <typename P>
+void BM_Copy(benchmark::State &state) {
+  const P path("/usr/local/share/doc/spin_2_fs/README.md");
+  for (auto _ : state) {
+    P copy(path);
+    benchmark::DoNotOptimize(copy);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_Copy, Path);
+BENCHMARK_TEMPLATE(BM_Copy, LocalPath);
+
+// Walks from a deep path up to the root, as code searching parent directories for a file would.
+template <typename P>
+void BM_ParentChain(benchmark::State &state) {
+  const P path("/a/b/c/d/e/f/g/h/i/j/k/l/m/n/o/p");
+  int64_t parents = 0;
+  for (auto _ : state) {
+    for (P p = path; !p.is_root(); p = p.parent()) {
+      benchmark::DoNotOptimize(p);
+      parents++;
+    }
+  }
+  state.SetItemsProcessed(parents);
+}
+BENCHMARK_TEMPLATE(BM_ParentChain, Path);
+BENCHMARK_TEMPLATE(BM_ParentChain, LocalPath);
+
+// Copies of one path held in a container, e.g. the directories queued by a walker.
+template <typename P>
+void BM_FillVector(benchmark::State &state) {
+  const P path("/usr/local/share/doc/spin_2_fs/README.md");
+  std::vector<P> copies;
+  copies.reserve(1024);
+  for (auto _ : state) {
+    for (int i = 0; i < 1024; i++) {
+      copies.push_back(path);
+    }
+    copies.clear();
+  }
+  state.SetItemsProcessed(state.iterations() * 1024);
+}
+BENCHMARK_TEMPLATE(BM_FillVector, Path);
+BENCHMARK_TEMPLATE(BM_FillVector, LocalPath);
+
+// Every thread copies the same Path, so its refcount's cache line bounces between cores. There is
+// no LocalPath counterpart, as a LocalPath can't be shared; per-thread LocalPaths are BM_Copy.
+void BM_CopySharedAcrossThreads(benchmark::State &state) {
+  static const Path *const path = new Path("/usr/local/share/doc/spin_2_fs/README.md");
+  for (auto _ : state) {
+    Path copy(*path);
+    benchmark::DoNotOptimize(copy);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CopySharedAcrossThreads)->ThreadRange(1, 8);
+
+}  // anonymous namespace
+}  // namespace spin_2_fs
+
+BENCHMARK_MAIN();
+// vim: sw=2:sts=2:tw=100:et:cindent:cinoptions=l1,g1,h1,N-s,E-s,i2s,+2s,(0,w1,W2s
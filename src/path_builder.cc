@@ -0,0 +1,117 @@
+// Copyright 2017 David Finkel
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "path_builder.h"
+
+namespace spin_2_fs {
+
+namespace {
+
+// Returns the offset at which the component pushed when buffer_ was offset bytes long starts.
+size_t ComponentStart(const std::string &buffer, size_t offset) {
+  return buffer[offset] == '/' ? offset + 1 : offset;
+}
+
+}  // anonymous namespace
+
+PathBuilder::PathBuilder(const Path &base) : base_(base) {
+  if (base_.num_components() > 0 || base_.is_absolute()) {
+    buffer_ = base_.to_string();
+    // Drop the trailing slash of directories, but not of the root.
+    if (buffer_.size() > 1 && buffer_.back() == '/') {
+      buffer_.pop_back();
+    }
+  }
+  // Otherwise base is ".", which is represented by an empty buffer so components can be appended
+  // directly.
+}
+
+bool PathBuilder::push(std::string_view component) {
+  if (component.empty() || component == "." || component == ".." ||
+      component.find('/') != std::string_view::npos) {
+    return false;
+  }
+  offsets_.push_back(buffer_.size());
+  if (!buffer_.empty() && buffer_.back() != '/') {
+    buffer_ += '/';
+  }
+  buffer_ += component;
+  return true;
+}
+
+bool PathBuilder::pop() {
+  if (offsets_.empty()) {
+    return false;
+  }
+  buffer_.resize(offsets_.back());
+  offsets_.pop_back();
+  return true;
+}
+
+std::string_view PathBuilder::view() const {
+  if (buffer_.empty()) {
+    return ".";
+  }
+  return buffer_;
+}
+
+const char *PathBuilder::c_str() const {
+  if (buffer_.empty()) {
+    return ".";
+  }
+  return buffer_.c_str();
+}
+
+std::string_view PathBuilder::last_component() const {
+  if (offsets_.empty()) {
+    if (base_.num_components() == 0) {
+      return std::string_view();
+    }
+    return base_.component(base_.num_components() - 1);
+  }
+  return std::string_view(buffer_).substr(ComponentStart(buffer_, offsets_.back()));
+}
+
+Path PathBuilder::to_path() const {
+  if (offsets_.empty()) {
+    return base_;
+  }
+  std::vector<std::string> components;
+  components.reserve(base_.num_components() + offsets_.size());
+  for (int64_t i = 0; i < base_.num_components(); i++) {
+    components.push_back(base_.component(i));
+  }
+  for (size_t i = 0; i < offsets_.size(); i++) {
+    const size_t start = ComponentStart(buffer_, offsets_[i]);
+    const size_t end = i + 1 < offsets_.size() ? offsets_[i + 1] : buffer_.size();
+    components.emplace_back(buffer_, start, end - start);
+  }
+  return Path(std::move(components), base_.is_absolute(), false);
+}
+
+}  // namespace spin_2_fs
+// vim: sw=2:sts=2:tw=100:et:cindent:cinoptions=l1,g1,h1,N-s,E-s,i2s,+2s,(0,w1,W2s
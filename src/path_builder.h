@@ -0,0 +1,79 @@
+// Copyright 2017 David Finkel
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef include_spin_2_fs_path_builder_h
+#define include_spin_2_fs_path_builder_h
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "path.h"
+
+namespace spin_2_fs {
+
+// PathBuilder is a mutable path intended for recursive traversal. It keeps the current path as a
+// single string along with a stack of component offsets, so pushing and popping a component only
+// appends to or truncates that string. Once the buffers have grown to the depth and name lengths of
+// a tree, walking it allocates nothing per entry; an immutable Path is only built by to_path().
+class PathBuilder {
+ public:
+  explicit PathBuilder(const Path &base);
+
+  // Appends a single component. Returns false, leaving the builder unchanged, if component is
+  // empty, "." or "..", or contains a '/'.
+  bool push(std::string_view component);
+  // Removes the most recently pushed component. Returns false if only the base remains.
+  bool pop();
+
+  // Number of components pushed on top of the base.
+  size_t depth() const { return offsets_.size(); }
+  const Path &base() const { return base_; }
+
+  // The current path in canonical form, without a trailing slash (except for "/"). Valid until
+  // the next push() or pop().
+  std::string_view view() const;
+  // As view(), but NUL-terminated for passing to syscalls.
+  const char *c_str() const;
+  // The most recently pushed component, or the base's last component if none have been pushed.
+  std::string_view last_component() const;
+
+  // Returns the current path as a Path, which is the base itself if nothing has been pushed.
+  Path to_path() const;
+
+ private:
+  const Path base_;
+  std::string buffer_;
+  // buffer_.size() before each push(), so that pop() can truncate back to it.
+  std::vector<size_t> offsets_;
+};
+
+}  // namespace spin_2_fs
+
+#endif  // include_spin_2_fs_path_builder_h
+// vim: sw=2:sts=2:tw=100:et:cindent:cinoptions=l1,g1,h1,N-s,E-s,i2s,+2s,(0,w1,W2s
@@ -0,0 +1,129 @@
+// Copyright 2017 David Finkel
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "path_builder.h"
+
+namespace spin_2_fs {
+
+namespace {
+
+TEST(TestPathBuilder, PushPopAbsolute) {
+  PathBuilder b(Path("/foo/bar/"));
+  EXPECT_EQ("/foo/bar", b.view());
+  EXPECT_EQ(0u, b.depth());
+  EXPECT_TRUE(b.push("bim"));
+  EXPECT_TRUE(b.push("bop"));
+  EXPECT_EQ("/foo/bar/bim/bop", b.view());
+  EXPECT_STREQ("/foo/bar/bim/bop", b.c_str());
+  EXPECT_EQ("bop", b.last_component());
+  EXPECT_EQ(2u, b.depth());
+  EXPECT_TRUE(b.pop());
+  EXPECT_EQ("/foo/bar/bim", b.view());
+  EXPECT_TRUE(b.pop());
+  EXPECT_EQ("/foo/bar", b.view());
+  EXPECT_EQ("bar", b.last_component());
+  EXPECT_FALSE(b.pop());
+  EXPECT_EQ("/foo/bar", b.view());
+}
+
+TEST(TestPathBuilder, Root) {
+  PathBuilder b(Path::Root());
+  EXPECT_EQ("/", b.view());
+  EXPECT_EQ("", b.last_component());
+  EXPECT_TRUE(b.push("usr"));
+  EXPECT_EQ("/usr", b.view());
+  EXPECT_EQ("usr", b.last_component());
+  EXPECT_TRUE(b.pop());
+  EXPECT_STREQ("/", b.c_str());
+}
+
+TEST(TestPathBuilder, Relative) {
+  PathBuilder dot(Path("."));
+  EXPECT_EQ(".", dot.view());
+  EXPECT_STREQ(".", dot.c_str());
+  EXPECT_TRUE(dot.push("a"));
+  EXPECT_EQ("a", dot.view());
+  EXPECT_EQ("a", dot.last_component());
+  EXPECT_EQ(Path("a"), dot.to_path());
+  EXPECT_TRUE(dot.pop());
+  EXPECT_STREQ(".", dot.c_str());
+
+  PathBuilder up(Path("../../x"));
+  EXPECT_TRUE(up.push("y"));
+  EXPECT_EQ("../../x/y", up.view());
+  EXPECT_EQ("../../x/y", up.to_path().to_string());
+}
+
+TEST(TestPathBuilder, InvalidComponents) {
+  PathBuilder b(Path("/a"));
+  EXPECT_FALSE(b.push(""));
+  EXPECT_FALSE(b.push("."));
+  EXPECT_FALSE(b.push(".."));
+  EXPECT_FALSE(b.push("b/c"));
+  EXPECT_TRUE(b.push("..."));
+  EXPECT_EQ("/a/...", b.view());
+  EXPECT_EQ(1u, b.depth());
+}
+
+TEST(TestPathBuilder, ToPath) {
+  const Path base("/foo/bar");
+  PathBuilder b(base);
+  EXPECT_EQ(base, b.to_path());
+  b.push("bim");
+  b.push("bop");
+  const Path p = b.to_path();
+  EXPECT_EQ("/foo/bar/bim/bop", p.to_string());
+  EXPECT_EQ(4, p.num_components());
+  EXPECT_EQ("bim", p.component(2));
+  EXPECT_TRUE(p.has_parent(base));
+  EXPECT_EQ(base / Path("bim/bop"), p);
+  // The snapshot is unaffected by later changes to the builder.
+  b.pop();
+  b.push("other");
+  EXPECT_EQ("/foo/bar/bim/bop", p.to_string());
+}
+
+TEST(TestPathBuilder, ReusesBuffer) {
+  PathBuilder b(Path("/base"));
+  b.push("a_fairly_long_directory_name");
+  b.push("and_a_fairly_long_file_name");
+  const char *const data = b.c_str();
+  for (int i = 0; i < 100; i++) {
+    b.pop();
+    b.pop();
+    b.push("another_directory_name");
+    b.push("another_file_name");
+    EXPECT_EQ(data, b.c_str());
+  }
+}
+
+}  // anonymous namespace
+}  // namespace spin_2_fs
+// vim: sw=2:sts=2:tw=100:et:cindent:cinoptions=l1,g1,h1,N-s,E-s,i2s,+2s,(0,w1,W2s
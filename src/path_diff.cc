@@ -0,0 +1,169 @@
+// Copyright 2017 David Finkel
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "path_diff.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace spin_2_fs {
+
+namespace {
+
+using PathIter = std::vector<Path>::const_iterator;
+
+struct Partition {
+  PathIter old_begin;
+  PathIter old_end;
+  PathIter new_begin;
+  PathIter new_end;
+  std::vector<PathDiffEntry> entries;
+  bool ok = true;
+};
+
+// Returns the single-component path naming the top-level directory containing path.
+Path TopLevel(const Path &path) {
+  return Path(std::vector<std::string>{path.component(0)}, path.is_absolute(), false);
+}
+
+// Returns true if a path with no components ("/" or ".") is present in only one of the inputs.
+// Such a path is the parent of everything that shares its absoluteness, so its subtree spans
+// partitions and only the serial diff can fold it.
+bool HasUnmatchedEmptyPath(const std::vector<Path> &old_paths,
+                           const std::vector<Path> &new_paths) {
+  for (const Path &empty : {Path::Root(), Path(std::vector<std::string>{}, false, true)}) {
+    if (std::binary_search(old_paths.begin(), old_paths.end(), empty) !=
+        std::binary_search(new_paths.begin(), new_paths.end(), empty)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Returns true if the elements on either side of it are in order.
+bool SortedAcross(const std::vector<Path> &paths, PathIter it) {
+  return it == paths.begin() || it == paths.end() || *(it - 1) < *it;
+}
+
+}  // anonymous namespace
+
+bool ParallelDiffSortedPaths(const std::vector<Path> &old_paths, const std::vector<Path> &new_paths,
+                             int num_threads,
+                             const std::function<void(PathDiffEntry)> &callback) {
+  if (num_threads <= 1 || (old_paths.empty() && new_paths.empty()) ||
+      HasUnmatchedEmptyPath(old_paths, new_paths)) {
+    return DiffSortedPaths(old_paths.begin(), old_paths.end(), new_paths.begin(),
+                           new_paths.end(), callback);
+  }
+
+  // Pick split points at roughly evenly spaced elements of the larger input, rounded down to the
+  // start of their top-level directory. Using several partitions per thread evens out skew
+  // between directories.
+  const std::vector<Path> &larger = old_paths.size() > new_paths.size() ? old_paths : new_paths;
+  const size_t target_partitions = static_cast<size_t>(num_threads) * 4;
+  std::vector<Partition> partitions(1);
+  partitions.back().old_begin = old_paths.begin();
+  partitions.back().new_begin = new_paths.begin();
+  std::optional<Path> last_key;
+  for (size_t i = 1; i < target_partitions; i++) {
+    const Path &sample = larger[i * larger.size() / target_partitions];
+    if (sample.num_components() == 0) {
+      continue;
+    }
+    Path key = TopLevel(sample);
+    if (last_key.has_value() && !(*last_key < key)) {
+      continue;
+    }
+    // Clamp so that partitions stay well-formed even if an input turns out to be unsorted; the
+    // order checks below and in DiffSortedPaths will report that.
+    const PathIter old_split = std::max(
+        partitions.back().old_begin, std::lower_bound(old_paths.begin(), old_paths.end(), key));
+    const PathIter new_split = std::max(
+        partitions.back().new_begin, std::lower_bound(new_paths.begin(), new_paths.end(), key));
+    if (!SortedAcross(old_paths, old_split) || !SortedAcross(new_paths, new_split)) {
+      return false;
+    }
+    partitions.back().old_end = old_split;
+    partitions.back().new_end = new_split;
+    partitions.emplace_back();
+    partitions.back().old_begin = old_split;
+    partitions.back().new_begin = new_split;
+    last_key.emplace(std::move(key));
+  }
+  partitions.back().old_end = old_paths.end();
+  partitions.back().new_end = new_paths.end();
+
+  std::atomic<size_t> next_partition{0};
+  auto worker = [&partitions, &next_partition]() {
+    for (size_t i = next_partition++; i < partitions.size(); i = next_partition++) {
+      Partition &p = partitions[i];
+      p.ok = DiffSortedPaths(p.old_begin, p.old_end, p.new_begin, p.new_end,
+                             [&p](PathDiffEntry entry) { p.entries.push_back(std::move(entry)); });
+    }
+  };
+  std::vector<std::thread> threads;
+  const size_t num_workers = std::min<size_t>(num_threads, partitions.size());
+  for (size_t i = 1; i < num_workers; i++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (std::thread &t : threads) {
+    t.join();
+  }
+
+  for (Partition &p : partitions) {
+    for (PathDiffEntry &entry : p.entries) {
+      callback(std::move(entry));
+    }
+    if (!p.ok) {
+      return false;
+    }
+  }
+  return true;
+}
+
+PathManifestIterator::PathManifestIterator(std::istream *in, char delimiter)
+    : in_(in), delimiter_(delimiter) {
+  ++*this;
+}
+
+PathManifestIterator &PathManifestIterator::operator++() {
+  while (std::getline(*in_, record_, delimiter_)) {
+    if (!record_.empty()) {
+      path_.emplace(record_);
+      return *this;
+    }
+  }
+  // Exhausted (or failed): become the end iterator.
+  in_ = nullptr;
+  path_.reset();
+  return *this;
+}
+
+}  // namespace spin_2_fs
+// vim: sw=2:sts=2:tw=100:et:cindent:cinoptions=l1,g1,h1,N-s,E-s,i2s,+2s,(0,w1,W2s
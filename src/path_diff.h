@@ -0,0 +1,182 @@
+// Copyright 2017 David Finkel
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef include_spin_2_fs_path_diff_h
+#define include_spin_2_fs_path_diff_h
+
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "path.h"
+
+namespace spin_2_fs {
+
+enum class PathDiffKind { kAdded, kRemoved };
+
+struct PathDiffEntry {
+  PathDiffKind kind;
+  // The path that was added or removed.
+  Path path;
+  // Number of input paths covered by this entry: 1 for the path itself, plus the number of its
+  // descendants that were folded into it because the whole subtree was added or removed.
+  uint64_t subtree_size;
+};
+
+namespace path_diff_internal {
+
+// Wraps an input range of Paths, verifying that it is strictly increasing as it goes.
+template <typename It>
+class SortedCursor {
+ public:
+  SortedCursor(It begin, It end) : it_(std::move(begin)), end_(std::move(end)) { Load(); }
+
+  bool done() const { return !head_.has_value(); }
+  // Returns false if the input was found to be out of order (or contain duplicates).
+  bool ok() const { return ok_; }
+  const Path &head() const { return *head_; }
+
+  void Advance() {
+    ++it_;
+    Load();
+  }
+
+ private:
+  void Load() {
+    if (it_ == end_) {
+      head_.reset();
+      return;
+    }
+    Path next(*it_);
+    if (head_.has_value() && !(*head_ < next)) {
+      ok_ = false;
+      head_.reset();
+      return;
+    }
+    head_.emplace(std::move(next));
+  }
+
+  It it_;
+  It end_;
+  std::optional<Path> head_;
+  bool ok_ = true;
+};
+
+// Emits from.head() as a kind entry. If other has nothing in from.head()'s subtree, every
+// descendant in from belongs to the same entry and is consumed as well.
+template <typename FromCursor, typename OtherCursor, typename Callback>
+void EmitSubtree(PathDiffKind kind, FromCursor *from, const OtherCursor &other,
+                 Callback &callback) {
+  PathDiffEntry entry{kind, from->head(), 1};
+  // Inputs are sorted with parents immediately before their children, so a subtree is a
+  // contiguous run. other.head() sorts after entry.path, so if it isn't a descendant then it
+  // sorts after the entire subtree.
+  const bool collapse = other.done() || !other.head().has_parent(entry.path);
+  from->Advance();
+  if (collapse) {
+    while (!from->done() && from->head().has_parent(entry.path)) {
+      entry.subtree_size++;
+      from->Advance();
+    }
+  }
+  callback(std::move(entry));
+}
+
+}  // namespace path_diff_internal
+
+// Merge-joins two ranges of Paths, each strictly increasing in Path::operator< order, calling
+// callback with a PathDiffEntry for every path present in only one of them. Entries are reported
+// in sorted order. When a path and all of its descendants are present in only one input, they
+// are reported as a single entry with subtree_size set accordingly.
+//
+// Only the current element of each input is held at a time, so the inputs may be streamed (see
+// PathManifestIterator). Paths differing only in a trailing slash are treated as equal.
+//
+// Returns false if either input was not strictly increasing, in which case the diff stops at the
+// first out-of-order element.
+template <typename OldIt, typename NewIt, typename Callback>
+bool DiffSortedPaths(OldIt old_begin, OldIt old_end, NewIt new_begin, NewIt new_end,
+                     Callback &&callback) {
+  path_diff_internal::SortedCursor<OldIt> old_paths(std::move(old_begin), std::move(old_end));
+  path_diff_internal::SortedCursor<NewIt> new_paths(std::move(new_begin), std::move(new_end));
+  while (old_paths.ok() && new_paths.ok() && (!old_paths.done() || !new_paths.done())) {
+    if (new_paths.done() || (!old_paths.done() && old_paths.head() < new_paths.head())) {
+      path_diff_internal::EmitSubtree(PathDiffKind::kRemoved, &old_paths, new_paths, callback);
+    } else if (old_paths.done() || new_paths.head() < old_paths.head()) {
+      path_diff_internal::EmitSubtree(PathDiffKind::kAdded, &new_paths, old_paths, callback);
+    } else {
+      old_paths.Advance();
+      new_paths.Advance();
+    }
+  }
+  return old_paths.ok() && new_paths.ok();
+}
+
+// Diffs two sorted in-memory manifests using up to num_threads threads. The inputs are split into
+// partitions at top-level component boundaries, which are diffed independently. The entries passed
+// to callback (from the calling thread) are identical to, and in the same order as, those
+// DiffSortedPaths would produce.
+bool ParallelDiffSortedPaths(const std::vector<Path> &old_paths, const std::vector<Path> &new_paths,
+                             int num_threads,
+                             const std::function<void(PathDiffEntry)> &callback);
+
+// Input iterator yielding the Paths in a delimiter-separated manifest read from a stream. Empty
+// records are skipped. A default-constructed PathManifestIterator is the end iterator.
+class PathManifestIterator {
+ public:
+  using iterator_category = std::input_iterator_tag;
+  using value_type = Path;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const Path *;
+  using reference = const Path &;
+
+  PathManifestIterator() = default;
+  explicit PathManifestIterator(std::istream *in, char delimiter = '\n');
+
+  const Path &operator*() const { return *path_; }
+  const Path *operator->() const { return &*path_; }
+  PathManifestIterator &operator++();
+
+  bool operator==(const PathManifestIterator &other) const { return in_ == other.in_; }
+  bool operator!=(const PathManifestIterator &other) const { return in_ != other.in_; }
+
+ private:
+  std::istream *in_ = nullptr;
+  char delimiter_ = '\n';
+  std::string record_;
+  std::optional<Path> path_;
+};
+
+}  // namespace spin_2_fs
+
+#endif  // include_spin_2_fs_path_diff_h
+// vim: sw=2:sts=2:tw=100:et:cindent:cinoptions=l1,g1,h1,N-s,E-s,i2s,+2s,(0,w1,W2s
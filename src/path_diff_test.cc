@@ -0,0 +1,161 @@
+// Copyright 2017 David Finkel
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include "path_diff.h"
+
+namespace spin_2_fs {
+namespace {
+
+std::vector<Path> Paths(const std::vector<std::string> &strs) {
+  std::vector<Path> paths;
+  for (const std::string &s : strs) {
+    paths.emplace_back(s);
+  }
+  return paths;
+}
+
+// Renders entries as "+/path" or "-/path", with the subtree size appended when it's not 1.
+std::vector<std::string> Diff(const std::vector<Path> &old_paths,
+                              const std::vector<Path> &new_paths, int num_threads = 1) {
+  std::vector<std::string> out;
+  auto callback = [&out](PathDiffEntry entry) {
+    std::string s = (entry.kind == PathDiffKind::kAdded ? "+" : "-") + entry.path.to_string();
+    if (entry.subtree_size != 1) {
+      s += " " + std::to_string(entry.subtree_size);
+    }
+    out.push_back(s);
+  };
+  bool ok;
+  if (num_threads == 1) {
+    ok = DiffSortedPaths(old_paths.begin(), old_paths.end(), new_paths.begin(), new_paths.end(),
+                         callback);
+  } else {
+    ok = ParallelDiffSortedPaths(old_paths, new_paths, num_threads, callback);
+  }
+  if (!ok) {
+    out.push_back("error");
+  }
+  return out;
+}
+
+TEST(TestPathDiff, Identical) {
+  const std::vector<Path> paths = Paths({"/a", "/a/b", "/c"});
+  EXPECT_THAT(Diff(paths, paths), testing::IsEmpty());
+  EXPECT_THAT(Diff({}, {}), testing::IsEmpty());
+}
+
+TEST(TestPathDiff, AddsAndRemoves) {
+  EXPECT_THAT(Diff(Paths({"/a", "/b", "/d"}), Paths({"/a", "/c", "/d", "/e"})),
+              testing::ElementsAre("-/b", "+/c", "+/e"));
+  EXPECT_THAT(Diff(Paths({"/a"}), {}), testing::ElementsAre("-/a"));
+  EXPECT_THAT(Diff({}, Paths({"/a", "b"})), testing::ElementsAre("+/a", "+b"));
+}
+
+TEST(TestPathDiff, SubtreesFold) {
+  EXPECT_THAT(Diff(Paths({"/a", "/z"}), Paths({"/a", "/a/b", "/a/b/c", "/a/b/d", "/a/e", "/z"})),
+              testing::ElementsAre("+/a/b 3", "+/a/e"));
+  EXPECT_THAT(Diff(Paths({"/a", "/a/b", "/a/b/c", "/a/c", "/b"}), Paths({"/b"})),
+              testing::ElementsAre("-/a 4"));
+  // "/a/b.c" sorts after the contents of "/a/b", so it isn't part of its subtree.
+  EXPECT_THAT(Diff(Paths({"/a/b.c"}), Paths({"/a/b", "/a/b/c", "/a/b.c"})),
+              testing::ElementsAre("+/a/b 2"));
+}
+
+TEST(TestPathDiff, PartialSubtree) {
+  // "/a" is new, but "/a/c" isn't, so "/a" can't swallow its children.
+  EXPECT_THAT(Diff(Paths({"/a/c"}), Paths({"/a", "/a/b", "/a/c", "/a/d", "/a/d/e"})),
+              testing::ElementsAre("+/a", "+/a/b", "+/a/d 2"));
+}
+
+TEST(TestPathDiff, TrailingSlashIgnored) {
+  EXPECT_THAT(Diff(Paths({"/a/", "/a/b"}), Paths({"/a", "/a/b/"})), testing::IsEmpty());
+}
+
+TEST(TestPathDiff, Unsorted) {
+  EXPECT_THAT(Diff(Paths({"/b", "/a"}), Paths({"/b"})), testing::ElementsAre("error"));
+  EXPECT_THAT(Diff(Paths({"/a"}), Paths({"/a", "/a"})), testing::ElementsAre("error"));
+}
+
+TEST(TestPathDiff, Manifests) {
+  std::istringstream old_manifest("/a\n/a/b\n/c\n\n/d\n");
+  std::istringstream new_manifest("/a\n/c\n/c/d\n/d");
+  std::vector<std::string> out;
+  auto record = [&out](PathDiffEntry entry) { out.push_back(entry.path.to_string()); };
+  EXPECT_TRUE(DiffSortedPaths(PathManifestIterator(&old_manifest), PathManifestIterator(),
+                              PathManifestIterator(&new_manifest), PathManifestIterator(), record));
+  EXPECT_THAT(out, testing::ElementsAre("/a/b", "/c/d"));
+
+  std::istringstream nul_manifest(std::string("/a\0/b\0", 6));
+  std::vector<Path> paths(PathManifestIterator(&nul_manifest, '\0'), PathManifestIterator());
+  EXPECT_THAT(paths, testing::ElementsAre(Path("/a"), Path("/b")));
+}
+
+TEST(TestPathDiff, ParallelMatchesSerial) {
+  std::vector<std::string> old_strs;
+  std::vector<std::string> new_strs;
+  for (int top = 0; top < 20; top++) {
+    for (int mid = 0; mid < 10; mid++) {
+      for (int leaf = 0; leaf < 5; leaf++) {
+        const std::string dir = "/t" + std::to_string(top) + "/m" + std::to_string(mid);
+        const std::string leaf_path = dir + "/l" + std::to_string(leaf);
+        const int h = (top * 31 + mid * 7 + leaf) % 9;
+        if (leaf == 0) {
+          if (h != 1) old_strs.push_back(dir);
+          if (h != 2) new_strs.push_back(dir);
+        }
+        if (h != 1 && h != 3) old_strs.push_back(leaf_path);
+        if (h != 2 && h != 4) new_strs.push_back(leaf_path);
+      }
+    }
+  }
+  old_strs.push_back("rel/a");
+  new_strs.push_back("rel/b");
+  std::vector<Path> old_paths = Paths(old_strs);
+  std::vector<Path> new_paths = Paths(new_strs);
+  std::sort(old_paths.begin(), old_paths.end());
+  std::sort(new_paths.begin(), new_paths.end());
+
+  const std::vector<std::string> serial = Diff(old_paths, new_paths);
+  EXPECT_THAT(serial, testing::Not(testing::IsEmpty()));
+  for (int threads : {2, 3, 8, 64}) {
+    EXPECT_EQ(serial, Diff(old_paths, new_paths, threads)) << threads << " threads";
+  }
+
+  // With "/" only on one side, everything folds into one entry.
+  new_paths.insert(new_paths.begin(), Path::Root());
+  EXPECT_EQ(Diff(old_paths, new_paths), Diff(old_paths, new_paths, 4));
+}
+
+}  // anonymous namespace
+}  // namespace spin_2_fs
+// vim: sw=2:sts=2:tw=100:et:cindent:cinoptions=l1,g1,h1,N-s,E-s,i2s,+2s,(0,w1,W2s
@@ -0,0 +1,278 @@
+// Copyright 2017 David Finkel
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "path_reader.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+namespace spin_2_fs {
+
+namespace {
+
+struct Chunk {
+  size_t index = 0;
+  // Chunks of mmapped files point into the mapping, chunks of streams own their data.
+  std::string_view mapped;
+  std::string owned;
+
+  std::string_view data() const { return owned.empty() ? mapped : std::string_view(owned); }
+};
+
+std::vector<Path> ParseChunk(std::string_view data, char delimiter) {
+  std::vector<Path> batch;
+  while (!data.empty()) {
+    const size_t end = data.find(delimiter);
+    const std::string_view record = data.substr(0, end);
+    if (!record.empty()) {
+      batch.emplace_back(record);
+    }
+    if (end == std::string_view::npos) {
+      break;
+    }
+    data.remove_prefix(end + 1);
+  }
+  return batch;
+}
+
+// Hands chunks from the reading thread to a pool of parsing threads, and their batches on to the
+// callback. At most max_in_flight chunks are between Push() and delivery at any time.
+class ChunkPipeline {
+ public:
+  ChunkPipeline(const PathReaderOptions &options, const PathBatchCallback &callback)
+      : delimiter_(options.delimiter), preserve_order_(options.preserve_order),
+        callback_(callback) {
+    int num_threads = options.num_threads;
+    if (num_threads <= 0) {
+      num_threads = std::max<int>(std::thread::hardware_concurrency(), 1);
+    }
+    max_in_flight_ = options.max_chunks_in_flight > 0 ? options.max_chunks_in_flight
+                                                      : 2 * num_threads;
+    for (int i = 0; i < num_threads; i++) {
+      workers_.emplace_back([this] { Work(); });
+    }
+  }
+
+  ~ChunkPipeline() { Finish(); }
+
+  // Blocks until there's room for another chunk in flight.
+  void Push(std::string_view mapped, std::string owned) {
+    std::unique_lock<std::mutex> lock(mu_);
+    space_cv_.wait(lock, [this] { return next_index_ - delivered_ < max_in_flight_; });
+    queue_.push_back(Chunk{next_index_++, mapped, std::move(owned)});
+    work_cv_.notify_one();
+  }
+
+  // Waits for every pushed chunk to be delivered.
+  void Finish() {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      done_ = true;
+    }
+    work_cv_.notify_all();
+    for (std::thread &t : workers_) {
+      t.join();
+    }
+    workers_.clear();
+  }
+
+ private:
+  void Work() {
+    for (;;) {
+      Chunk chunk;
+      {
+        std::unique_lock<std::mutex> lock(mu_);
+        work_cv_.wait(lock, [this] { return !queue_.empty() || done_; });
+        if (queue_.empty()) {
+          return;
+        }
+        chunk = std::move(queue_.front());
+        queue_.pop_front();
+      }
+      std::vector<Path> batch = ParseChunk(chunk.data(), delimiter_);
+      // Release the chunk's buffer before waiting for our turn.
+      chunk.owned = std::string();
+      Deliver(chunk.index, std::move(batch));
+    }
+  }
+
+  void Deliver(size_t index, std::vector<Path> batch) {
+    if (preserve_order_) {
+      // Chunks are dequeued in index order, so the chunk being waited for is always either being
+      // parsed or about to be delivered; it never waits behind a later one.
+      std::unique_lock<std::mutex> lock(mu_);
+      turn_cv_.wait(lock, [this, index] { return delivered_ == index; });
+      lock.unlock();
+      if (!batch.empty()) {
+        callback_(std::move(batch));
+      }
+      lock.lock();
+      delivered_++;
+      turn_cv_.notify_all();
+      space_cv_.notify_one();
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(callback_mu_);
+      if (!batch.empty()) {
+        callback_(std::move(batch));
+      }
+    }
+    std::lock_guard<std::mutex> lock(mu_);
+    delivered_++;
+    space_cv_.notify_one();
+  }
+
+  const char delimiter_;
+  const bool preserve_order_;
+  const PathBatchCallback &callback_;
+  size_t max_in_flight_;
+  std::vector<std::thread> workers_;
+
+  std::mutex mu_;
+  std::condition_variable work_cv_;
+  std::condition_variable space_cv_;
+  std::condition_variable turn_cv_;
+  std::deque<Chunk> queue_;
+  size_t next_index_ = 0;
+  size_t delivered_ = 0;
+  bool done_ = false;
+
+  // Serializes callbacks when preserve_order_ is false.
+  std::mutex callback_mu_;
+};
+
+void PushMapped(std::string_view data, const PathReaderOptions &options, ChunkPipeline *pipeline) {
+  const size_t chunk_size = std::max<size_t>(options.chunk_size, 1);
+  while (!data.empty()) {
+    size_t end = data.size();
+    if (chunk_size < data.size()) {
+      const size_t delim = data.find(options.delimiter, chunk_size - 1);
+      if (delim != std::string_view::npos) {
+        end = delim + 1;
+      }
+    }
+    pipeline->Push(data.substr(0, end), std::string());
+    data.remove_prefix(end);
+  }
+}
+
+bool PushStream(int fd, const PathReaderOptions &options, ChunkPipeline *pipeline) {
+  const size_t chunk_size = std::max<size_t>(options.chunk_size, 1);
+  std::string buf;
+  bool eof = false;
+  while (!eof) {
+    // Fill the buffer to chunk_size bytes, or grow it if it's already holding a longer record.
+    size_t filled = buf.size();
+    const size_t want = std::max(chunk_size, filled + chunk_size / 2 + 1);
+    buf.resize(want);
+    while (filled < want && !eof) {
+      const ssize_t n = read(fd, &buf[filled], want - filled);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      eof = n == 0;
+      filled += n;
+    }
+    buf.resize(filled);
+    if (buf.empty()) {
+      break;
+    }
+    // Cut after the last complete record, carrying the remainder into the next chunk.
+    std::string rest;
+    if (!eof) {
+      const size_t last = buf.rfind(options.delimiter);
+      if (last == std::string::npos) {
+        // A single record longer than the chunk; keep reading until it ends.
+        continue;
+      }
+      rest.assign(buf, last + 1, std::string::npos);
+      buf.resize(last + 1);
+    }
+    if (!buf.empty()) {
+      pipeline->Push(std::string_view(), std::move(buf));
+    }
+    buf = std::move(rest);
+  }
+  return true;
+}
+
+}  // anonymous namespace
+
+bool ReadPathFd(int fd, const PathReaderOptions &options, const PathBatchCallback &callback) {
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    return false;
+  }
+  // Files in procfs and sysfs report a size of 0 despite having contents, so empty files are read
+  // as a stream too.
+  if (S_ISREG(st.st_mode) && st.st_size > 0) {
+    void *mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping != MAP_FAILED) {
+      madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+      {
+        ChunkPipeline pipeline(options, callback);
+        PushMapped(std::string_view(static_cast<const char *>(mapping), st.st_size), options,
+                   &pipeline);
+        pipeline.Finish();
+      }
+      munmap(mapping, st.st_size);
+      return true;
+    }
+  }
+  ChunkPipeline pipeline(options, callback);
+  const bool ok = PushStream(fd, options, &pipeline);
+  pipeline.Finish();
+  return ok;
+}
+
+bool ReadPathFile(const std::string &filename, const PathReaderOptions &options,
+                  const PathBatchCallback &callback) {
+  const int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  const bool ok = ReadPathFd(fd, options, callback);
+  close(fd);
+  return ok;
+}
+
+}  // namespace spin_2_fs
+// vim: sw=2:sts=2:tw=100:et:cindent:cinoptions=l1,g1,h1,N-s,E-s,i2s,+2s,(0,w1,W2s
@@ -0,0 +1,73 @@
+// Copyright 2017 David Finkel
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef include_spin_2_fs_path_reader_h
+#define include_spin_2_fs_path_reader_h
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "path.h"
+
+namespace spin_2_fs {
+
+struct PathReaderOptions {
+  // Record separator: '\n' for line-separated manifests, '\0' for `find -print0` output.
+  char delimiter = '\n';
+  // Number of threads parsing chunks, in addition to the calling thread which reads the input.
+  // 0 uses std::thread::hardware_concurrency().
+  int num_threads = 0;
+  // Target size of the chunks the input is cut into. Chunks always end on a delimiter, so a chunk
+  // is larger than this if a single record is.
+  size_t chunk_size = 1 << 20;
+  // Maximum number of chunks that have been read but whose batches have not yet been delivered,
+  // which bounds memory use. 0 uses twice the number of threads.
+  int max_chunks_in_flight = 0;
+  // Deliver batches in input order. Otherwise they're delivered as soon as they're parsed.
+  bool preserve_order = false;
+};
+
+// Receives the Paths parsed from one chunk. Calls are never concurrent, but may be made from any of
+// the reader's threads.
+using PathBatchCallback = std::function<void(std::vector<Path> batch)>;
+
+// Reads a file of delimiter-separated paths, canonicalizing them in parallel and passing them to
+// callback in batches. Empty records are skipped. Regular files are mmapped; anything else is read
+// as a stream. Returns false if the file could not be opened or read.
+bool ReadPathFile(const std::string &filename, const PathReaderOptions &options,
+                  const PathBatchCallback &callback);
+
+// As ReadPathFile(), but reads from an already open file descriptor (e.g. a pipe). The descriptor
+// is not closed.
+bool ReadPathFd(int fd, const PathReaderOptions &options, const PathBatchCallback &callback);
+
+}  // namespace spin_2_fs
+
+#endif  // include_spin_2_fs_path_reader_h
+// vim: sw=2:sts=2:tw=100:et:cindent:cinoptions=l1,g1,h1,N-s,E-s,i2s,+2s,(0,w1,W2s
@@ -0,0 +1,182 @@
+// Copyright 2017 David Finkel
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <thread>
+
+#include "path_reader.h"
+
+namespace spin_2_fs {
+namespace {
+
+class TestPathReader : public testing::Test {
+ protected:
+  void SetUp() override {
+    char name[] = "/tmp/path_reader_test.XXXXXX";
+    const int fd = mkstemp(name);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    filename_ = name;
+  }
+  void TearDown() override { unlink(filename_.c_str()); }
+
+  void WriteFile(const std::string &contents) {
+    const int fd = open(filename_.c_str(), O_WRONLY | O_TRUNC);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(static_cast<ssize_t>(contents.size()), write(fd, contents.data(), contents.size()));
+    close(fd);
+  }
+
+  // Reads filename_ and returns the paths in delivery order, and the number of batches.
+  std::vector<std::string> Read(const PathReaderOptions &options, int *num_batches = nullptr) {
+    std::vector<std::string> out;
+    int batches = 0;
+    EXPECT_TRUE(ReadPathFile(filename_, options, [&](std::vector<Path> batch) {
+      batches++;
+      for (const Path &p : batch) {
+        out.push_back(p.to_string());
+      }
+    }));
+    if (num_batches != nullptr) {
+      *num_batches = batches;
+    }
+    return out;
+  }
+
+  std::string filename_;
+};
+
+TEST_F(TestPathReader, Newlines) {
+  WriteFile("/foo/bar\n/foo/./bim/\n\nrel/../a\n/last");
+  EXPECT_THAT(Read(PathReaderOptions()),
+              testing::ElementsAre("/foo/bar", "/foo/bim/", "a", "/last"));
+}
+
+TEST_F(TestPathReader, Nuls) {
+  WriteFile(std::string("/a b\n\0/c\0", 9));
+  PathReaderOptions options;
+  options.delimiter = '\0';
+  EXPECT_THAT(Read(options), testing::ElementsAre("/a b\n", "/c"));
+}
+
+TEST_F(TestPathReader, Empty) {
+  WriteFile("");
+  EXPECT_THAT(Read(PathReaderOptions()), testing::IsEmpty());
+}
+
+TEST_F(TestPathReader, MissingFile) {
+  EXPECT_FALSE(ReadPathFile("/nonexistent/path_reader_test", PathReaderOptions(),
+                            [](std::vector<Path>) {}));
+}
+
+TEST_F(TestPathReader, PreserveOrder) {
+  std::string contents;
+  std::vector<std::string> expected;
+  for (int i = 0; i < 5000; i++) {
+    expected.push_back("/dir" + std::to_string(i % 17) + "/file" + std::to_string(i));
+    contents += expected.back() + "\n";
+  }
+  WriteFile(contents);
+  PathReaderOptions options;
+  options.num_threads = 4;
+  options.chunk_size = 100;
+  options.max_chunks_in_flight = 3;
+  options.preserve_order = true;
+  int num_batches = 0;
+  EXPECT_EQ(expected, Read(options, &num_batches));
+  EXPECT_GT(num_batches, 100);
+
+  options.preserve_order = false;
+  EXPECT_THAT(Read(options), testing::UnorderedElementsAreArray(expected));
+}
+
+TEST_F(TestPathReader, RecordsLongerThanChunks) {
+  const std::string long_path = "/" + std::string(300, 'x') + "/y";
+  WriteFile("/a\n" + long_path + "\n/b\n");
+  PathReaderOptions options;
+  options.chunk_size = 7;
+  options.preserve_order = true;
+  EXPECT_THAT(Read(options), testing::ElementsAre("/a", long_path, "/b"));
+}
+
+TEST(TestPathReaderStream, Pipe) {
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  std::string contents;
+  std::vector<std::string> expected;
+  for (int i = 0; i < 2000; i++) {
+    expected.push_back("/p/" + std::to_string(i) + (i % 100 == 0 ? std::string(200, 'z') : ""));
+    contents += expected.back() + '\0';
+  }
+  contents += "/no/trailing/delimiter";
+  expected.push_back("/no/trailing/delimiter");
+  std::thread writer([&] {
+    for (size_t off = 0; off < contents.size(); off += 61) {
+      const size_t n = std::min<size_t>(61, contents.size() - off);
+      ASSERT_EQ(static_cast<ssize_t>(n), write(fds[1], contents.data() + off, n));
+    }
+    close(fds[1]);
+  });
+  PathReaderOptions options;
+  options.delimiter = '\0';
+  options.num_threads = 3;
+  options.chunk_size = 128;
+  options.preserve_order = true;
+  std::vector<std::string> out;
+  EXPECT_TRUE(ReadPathFd(fds[0], options, [&](std::vector<Path> batch) {
+    for (const Path &p : batch) {
+      out.push_back(p.to_string());
+    }
+  }));
+  writer.join();
+  close(fds[0]);
+  EXPECT_EQ(expected, out);
+}
+
+TEST(TestPathReaderStream, ZeroSizeProcFile) {
+  // procfs files are regular files that report a size of 0 but have contents.
+  struct stat st;
+  ASSERT_EQ(0, stat("/proc/self/cmdline", &st));
+  ASSERT_EQ(0, st.st_size);
+  PathReaderOptions options;
+  options.delimiter = '\0';
+  size_t paths = 0;
+  EXPECT_TRUE(ReadPathFile("/proc/self/cmdline", options,
+                           [&paths](std::vector<Path> batch) { paths += batch.size(); }));
+  EXPECT_GE(paths, 1u);
+}
+
+}  // anonymous namespace
+}  // namespace spin_2_fs
+// vim: sw=2:sts=2:tw=100:et:cindent:cinoptions=l1,g1,h1,N-s,E-s,i2s,+2s,(0,w1,W2s
@@ -0,0 +1,610 @@
+// Copyright 2017 David Finkel
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "path_set.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <unordered_map>
+
+namespace spin_2_fs {
+
+namespace {
+
+// The serialized form is a sequence of 64-bit words in the byte order of the machine that built
+// it: a header, followed by the sections described in Layout. The words are used in place, so a
+// set can only be loaded on a machine of the same byte order. The magic number doubles as the
+// marker of that order, since on one of the other order it reads byte-swapped and doesn't match.
+constexpr uint64_t kMagic = 0x3154455348544150;  // "PATHSET1" when little-endian
+enum HeaderWord {
+  kMagicWord = 0,
+  kFlags,
+  kNumNodes,
+  kNumMembers,
+  kLabelBits,
+  kDictSize,
+  kDictBytes,
+  kHeaderWords,
+};
+constexpr uint64_t kFlagAbsolute = 1;
+
+// The LOUDS bits are indexed with the number of ones preceding every block of this many bits.
+constexpr uint64_t kBlockWords = 8;
+constexpr uint64_t kBlockBits = kBlockWords * 64;
+
+constexpr uint64_t kBucketSize = 16;
+
+uint64_t NumBuckets(uint64_t dict_size) { return (dict_size + kBucketSize - 1) / kBucketSize; }
+
+uint64_t WordsFor(uint64_t bits) { return (bits + 63) / 64; }
+
+// Word offsets of each section.
+struct Layout {
+  // Nodes in breadth-first order, each written as one 1 bit per child followed by a 0.
+  uint64_t louds;
+  uint64_t louds_words;
+  // Number of ones before each block of louds, plus a final total.
+  uint64_t louds_rank;
+  uint64_t louds_blocks;
+  // One bit per node, set if the node is a member.
+  uint64_t members;
+  // label_bits per node: the node's component as an index into the dictionary.
+  uint64_t labels;
+  // The distinct component names in sorted order, front-coded in buckets of kBucketSize: the
+  // first name of a bucket is stored as a varint length and its bytes, and each following one as
+  // the varint length of the prefix it shares with its predecessor, a varint suffix length and
+  // the suffix bytes. dict_offsets holds the byte offset of each bucket plus the total.
+  uint64_t dict_offsets;
+  uint64_t dict_bytes;
+  uint64_t total;
+};
+
+Layout ComputeLayout(uint64_t num_nodes, uint64_t label_bits, uint64_t dict_size,
+                     uint64_t dict_bytes) {
+  Layout l;
+  l.louds = kHeaderWords;
+  l.louds_words = WordsFor(2 * num_nodes - 1);
+  l.louds_rank = l.louds + l.louds_words;
+  l.louds_blocks = (l.louds_words + kBlockWords - 1) / kBlockWords;
+  l.members = l.louds_rank + l.louds_blocks + 1;
+  l.labels = l.members + WordsFor(num_nodes);
+  l.dict_offsets = l.labels + WordsFor(num_nodes * label_bits);
+  l.dict_bytes = l.dict_offsets + NumBuckets(dict_size) + 1;
+  l.total = l.dict_bytes + WordsFor(dict_bytes * 8);
+  return l;
+}
+
+void SetBit(uint64_t *words, uint64_t i) { words[i / 64] |= uint64_t{1} << (i % 64); }
+bool GetBit(const uint64_t *words, uint64_t i) { return (words[i / 64] >> (i % 64)) & 1; }
+
+// Returns the position of the k'th (0-based) set bit of word, which must have more than k set.
+int SelectInWord(uint64_t word, uint64_t k) {
+  for (; k > 0; k--) {
+    word &= word - 1;
+  }
+  return __builtin_ctzll(word);
+}
+
+void PutVarint(uint64_t value, std::string *out) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+uint64_t GetVarint(const char **p) {
+  uint64_t value = 0;
+  for (int shift = 0;; shift += 7) {
+    const uint8_t byte = static_cast<uint8_t>(*(*p)++);
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      return value;
+    }
+  }
+}
+
+// Trie node used while building, in depth-first order.
+struct BuildNode {
+  uint64_t label = 0;
+  uint64_t first_child = 0;
+  uint64_t next_sibling = 0;
+  uint64_t last_child = 0;
+  bool member = false;
+};
+
+// Owns the buffer of a set that was built in memory.
+struct OwnedBuffer {
+  std::vector<uint64_t> words;
+};
+
+// Owns the mapping of a set loaded from a file.
+struct Mapping {
+  void *addr;
+  size_t len;
+  ~Mapping() { munmap(addr, len); }
+};
+
+}  // anonymous namespace
+
+std::optional<SuccinctPathSet> SuccinctPathSet::Build(const std::vector<Path> &paths) {
+  const bool absolute = paths.empty() || paths.front().is_absolute();
+
+  // Insert the paths into a trie in depth-first order, interning component names as we go. Node 0
+  // is the root, so 0 doubles as "no node" for child and sibling links.
+  std::vector<BuildNode> nodes(1);
+  std::vector<std::string> names;
+  std::unordered_map<std::string, uint64_t> name_ids;
+  // The nodes along the previous path.
+  std::vector<uint64_t> stack = {0};
+  for (size_t i = 0; i < paths.size(); i++) {
+    const Path &path = paths[i];
+    if (path.is_absolute() != absolute || (i > 0 && path < paths[i - 1])) {
+      return std::nullopt;
+    }
+    const int64_t n = path.num_components();
+    size_t common = 0;
+    while (common + 1 < stack.size() && static_cast<int64_t>(common) < n &&
+           names[nodes[stack[common + 1]].label] == path.component(common)) {
+      common++;
+    }
+    stack.resize(common + 1);
+    for (int64_t c = common; c < n; c++) {
+      const auto inserted = name_ids.emplace(path.component(c), names.size());
+      if (inserted.second) {
+        names.push_back(path.component(c));
+      }
+      const uint64_t id = nodes.size();
+      nodes.emplace_back();
+      nodes.back().label = inserted.first->second;
+      BuildNode &parent = nodes[stack.back()];
+      if (parent.first_child == 0) {
+        parent.first_child = id;
+      } else {
+        nodes[parent.last_child].next_sibling = id;
+      }
+      parent.last_child = id;
+      stack.push_back(id);
+    }
+    nodes[stack.back()].member = true;
+  }
+  name_ids.clear();
+
+  // Sort the dictionary so that comparing label indices compares names.
+  std::vector<uint64_t> order(names.size());
+  for (uint64_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(),
+            [&names](uint64_t a, uint64_t b) { return names[a] < names[b]; });
+  std::vector<uint64_t> remap(names.size());
+  std::string dict;
+  std::vector<uint64_t> bucket_offsets;
+  for (uint64_t i = 0; i < order.size(); i++) {
+    remap[order[i]] = i;
+    const std::string &name = names[order[i]];
+    if (i % kBucketSize == 0) {
+      bucket_offsets.push_back(dict.size());
+      PutVarint(name.size(), &dict);
+      dict += name;
+      continue;
+    }
+    const std::string &prev = names[order[i - 1]];
+    const size_t shared =
+        std::mismatch(name.begin(), name.begin() + std::min(name.size(), prev.size()), prev.begin())
+            .first -
+        name.begin();
+    PutVarint(shared, &dict);
+    PutVarint(name.size() - shared, &dict);
+    dict.append(name, shared, std::string::npos);
+  }
+  bucket_offsets.push_back(dict.size());
+  uint64_t label_bits = 0;
+  while ((uint64_t{1} << label_bits) < names.size()) {
+    label_bits++;
+  }
+
+  const uint64_t num_nodes = nodes.size();
+  const Layout layout = ComputeLayout(num_nodes, label_bits, names.size(), dict.size());
+  auto buffer = std::make_shared<OwnedBuffer>();
+  std::vector<uint64_t> &words = buffer->words;
+  words.resize(layout.total);
+  words[kMagicWord] = kMagic;
+  words[kFlags] = absolute ? kFlagAbsolute : 0;
+  words[kNumNodes] = num_nodes;
+  words[kNumMembers] = 0;
+  words[kLabelBits] = label_bits;
+  words[kDictSize] = names.size();
+  words[kDictBytes] = dict.size();
+
+  // Lay the nodes out breadth-first.
+  std::vector<uint64_t> bfs;
+  bfs.reserve(num_nodes);
+  bfs.push_back(0);
+  uint64_t bit = 0;
+  for (uint64_t i = 0; i < bfs.size(); i++) {
+    const BuildNode &node = nodes[bfs[i]];
+    for (uint64_t c = node.first_child; c != 0; c = nodes[c].next_sibling) {
+      bfs.push_back(c);
+      SetBit(&words[layout.louds], bit++);
+    }
+    bit++;
+    if (node.member) {
+      SetBit(&words[layout.members], i);
+      words[kNumMembers]++;
+    }
+    if (i > 0) {
+      const uint64_t label = remap[node.label];
+      for (uint64_t b = 0; b < label_bits; b++) {
+        if ((label >> b) & 1) {
+          SetBit(&words[layout.labels], i * label_bits + b);
+        }
+      }
+    }
+  }
+  uint64_t ones = 0;
+  for (uint64_t b = 0; b <= layout.louds_blocks; b++) {
+    words[layout.louds_rank + b] = ones;
+    for (uint64_t w = b * kBlockWords; w < (b + 1) * kBlockWords && w < layout.louds_words; w++) {
+      ones += __builtin_popcountll(words[layout.louds + w]);
+    }
+  }
+  std::copy(bucket_offsets.begin(), bucket_offsets.end(), &words[layout.dict_offsets]);
+  std::copy(dict.begin(), dict.end(), reinterpret_cast<char *>(&words[layout.dict_bytes]));
+
+  SuccinctPathSet set;
+  const std::string_view data(reinterpret_cast<const char *>(words.data()),
+                              words.size() * sizeof(uint64_t));
+  if (!set.Init(std::move(buffer), data)) {
+    return std::nullopt;
+  }
+  return set;
+}
+
+std::optional<SuccinctPathSet> SuccinctPathSet::FromBuffer(std::string_view data) {
+  SuccinctPathSet set;
+  if (!set.Init(nullptr, data)) {
+    return std::nullopt;
+  }
+  return set;
+}
+
+std::optional<SuccinctPathSet> SuccinctPathSet::Load(const std::string &filename) {
+  const int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return std::nullopt;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return std::nullopt;
+  }
+  void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return std::nullopt;
+  }
+  std::shared_ptr<const Mapping> mapping(new Mapping{addr, static_cast<size_t>(st.st_size)});
+  const std::string_view data(static_cast<const char *>(addr), st.st_size);
+  SuccinctPathSet set;
+  if (!set.Init(std::move(mapping), data)) {
+    return std::nullopt;
+  }
+  return set;
+}
+
+bool SuccinctPathSet::Init(std::shared_ptr<const void> owner, std::string_view data) {
+  if (reinterpret_cast<uintptr_t>(data.data()) % alignof(uint64_t) != 0 ||
+      data.size() % sizeof(uint64_t) != 0 || data.size() < kHeaderWords * sizeof(uint64_t)) {
+    return false;
+  }
+  const uint64_t *words = reinterpret_cast<const uint64_t *>(data.data());
+  const uint64_t num_words = data.size() / sizeof(uint64_t);
+  if (words[kMagicWord] != kMagic || words[kNumNodes] == 0 || words[kLabelBits] > 63 ||
+      words[kNumNodes] > num_words * 64 || words[kDictBytes] > data.size() ||
+      words[kDictSize] > words[kDictBytes]) {
+    return false;
+  }
+  // Every name takes at least a byte of the dictionary, so the bounds above keep the layout's
+  // arithmetic from overflowing.
+  const Layout layout =
+      ComputeLayout(words[kNumNodes], words[kLabelBits], words[kDictSize], words[kDictBytes]);
+  if (layout.total != num_words) {
+    return false;
+  }
+  owner_ = std::move(owner);
+  data_ = data;
+  header_ = words;
+  louds_ = words + layout.louds;
+  louds_words_ = layout.louds_words;
+  louds_rank_ = words + layout.louds_rank;
+  louds_blocks_ = layout.louds_blocks;
+  members_ = words + layout.members;
+  labels_ = words + layout.labels;
+  label_bits_ = words[kLabelBits];
+  dict_offsets_ = words + layout.dict_offsets;
+  dict_bytes_ = reinterpret_cast<const char *>(words + layout.dict_bytes);
+  dict_size_ = words[kDictSize];
+  return true;
+}
+
+std::string_view SuccinctPathSet::serialized() const { return data_; }
+
+bool SuccinctPathSet::Save(const std::string &filename) const {
+  std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+  out.write(data_.data(), data_.size());
+  out.close();
+  return !out.fail();
+}
+
+bool SuccinctPathSet::is_absolute() const { return header_[kFlags] & kFlagAbsolute; }
+
+uint64_t SuccinctPathSet::size() const { return header_[kNumMembers]; }
+
+uint64_t SuccinctPathSet::num_nodes() const { return header_[kNumNodes]; }
+
+uint64_t SuccinctPathSet::Rank1(uint64_t pos) const {
+  const uint64_t block = pos / kBlockBits;
+  uint64_t rank = louds_rank_[block];
+  const uint64_t word = pos / 64;
+  for (uint64_t w = block * kBlockWords; w < word; w++) {
+    rank += __builtin_popcountll(louds_[w]);
+  }
+  if (pos % 64 != 0) {
+    rank += __builtin_popcountll(louds_[word] & ((uint64_t{1} << (pos % 64)) - 1));
+  }
+  return rank;
+}
+
+uint64_t SuccinctPathSet::Select0(uint64_t k) const {
+  // Find the last block with at most k zeros before it.
+  uint64_t lo = 0;
+  uint64_t hi = louds_blocks_;
+  while (hi - lo > 1) {
+    const uint64_t mid = lo + (hi - lo) / 2;
+    if (mid * kBlockBits - louds_rank_[mid] <= k) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  k -= lo * kBlockBits - louds_rank_[lo];
+  for (uint64_t w = lo * kBlockWords;; w++) {
+    const uint64_t zeros = ~louds_[w];
+    const uint64_t count = __builtin_popcountll(zeros);
+    if (k < count) {
+      return w * 64 + SelectInWord(zeros, k);
+    }
+    k -= count;
+  }
+}
+
+std::pair<uint64_t, uint64_t> SuccinctPathSet::Children(uint64_t node) const {
+  // Node i's bits are the ones between the (i-1)'th and i'th zeros, and the j'th one in the
+  // sequence is node j + 1 (the root has no 1 bit).
+  const uint64_t start = node == 0 ? 0 : Select0(node - 1) + 1;
+  const uint64_t end = Select0(node);
+  return {Rank1(start) + 1, end - start};
+}
+
+uint64_t SuccinctPathSet::Label(uint64_t node) const {
+  if (label_bits_ == 0) {
+    return 0;
+  }
+  const uint64_t bit = node * label_bits_;
+  const uint64_t word = bit / 64;
+  const uint64_t shift = bit % 64;
+  uint64_t value = labels_[word] >> shift;
+  if (shift + label_bits_ > 64) {
+    value |= labels_[word + 1] << (64 - shift);
+  }
+  return value & ((uint64_t{1} << label_bits_) - 1);
+}
+
+std::string_view SuccinctPathSet::BucketHead(uint64_t bucket, const char **next) const {
+  const char *p = dict_bytes_ + dict_offsets_[bucket];
+  const uint64_t size = GetVarint(&p);
+  *next = p + size;
+  return std::string_view(p, size);
+}
+
+std::string SuccinctPathSet::LabelString(uint64_t label) const {
+  const char *p;
+  std::string name(BucketHead(label / kBucketSize, &p));
+  for (uint64_t i = 0; i < label % kBucketSize; i++) {
+    const uint64_t shared = GetVarint(&p);
+    const uint64_t suffix = GetVarint(&p);
+    name.resize(shared);
+    name.append(p, suffix);
+    p += suffix;
+  }
+  return name;
+}
+
+bool SuccinctPathSet::IsMember(uint64_t node) const { return GetBit(members_, node); }
+
+std::optional<uint64_t> SuccinctPathSet::LookupLabel(std::string_view component) const {
+  if (dict_size_ == 0) {
+    return std::nullopt;
+  }
+  // Find the last bucket whose first name is <= component, then scan it.
+  const char *p;
+  uint64_t lo = 0;
+  uint64_t hi = NumBuckets(dict_size_);
+  while (hi - lo > 1) {
+    const uint64_t mid = lo + (hi - lo) / 2;
+    if (BucketHead(mid, &p) <= component) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  std::string name(BucketHead(lo, &p));
+  const uint64_t bucket_end = std::min(dict_size_, (lo + 1) * kBucketSize);
+  for (uint64_t label = lo * kBucketSize;; label++) {
+    const int cmp = std::string_view(name).compare(component);
+    if (cmp == 0) {
+      return label;
+    }
+    if (cmp > 0 || label + 1 == bucket_end) {
+      return std::nullopt;
+    }
+    const uint64_t shared = GetVarint(&p);
+    const uint64_t suffix = GetVarint(&p);
+    name.resize(shared);
+    name.append(p, suffix);
+    p += suffix;
+  }
+}
+
+std::optional<uint64_t> SuccinctPathSet::FindChild(uint64_t node, uint64_t label) const {
+  const auto [first, count] = Children(node);
+  uint64_t lo = first;
+  uint64_t hi = first + count;
+  while (lo < hi) {
+    const uint64_t mid = lo + (hi - lo) / 2;
+    if (Label(mid) < label) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo < first + count && Label(lo) == label) {
+    return lo;
+  }
+  return std::nullopt;
+}
+
+std::optional<uint64_t> SuccinctPathSet::Find(const Path &path) const {
+  if (path.is_absolute() != is_absolute()) {
+    return std::nullopt;
+  }
+  uint64_t node = 0;
+  for (int64_t i = 0; i < path.num_components(); i++) {
+    const std::optional<uint64_t> label = LookupLabel(path.component(i));
+    if (!label.has_value()) {
+      return std::nullopt;
+    }
+    const std::optional<uint64_t> child = FindChild(node, *label);
+    if (!child.has_value()) {
+      return std::nullopt;
+    }
+    node = *child;
+  }
+  return node;
+}
+
+bool SuccinctPathSet::contains(const Path &path) const {
+  const std::optional<uint64_t> node = Find(path);
+  return node.has_value() && IsMember(*node);
+}
+
+bool SuccinctPathSet::contains_descendant_of(const Path &dir) const {
+  // Every leaf is a member, so any node with children has a member below it.
+  const std::optional<uint64_t> node = Find(dir);
+  return node.has_value() && Children(*node).second > 0;
+}
+
+bool SuccinctPathSet::contains_ancestor_of(const Path &path) const {
+  if (path.is_absolute() != is_absolute()) {
+    return false;
+  }
+  uint64_t node = 0;
+  for (int64_t i = 0; i < path.num_components(); i++) {
+    if (IsMember(node)) {
+      return true;
+    }
+    const std::optional<uint64_t> label = LookupLabel(path.component(i));
+    if (!label.has_value()) {
+      return false;
+    }
+    const std::optional<uint64_t> child = FindChild(node, *label);
+    if (!child.has_value()) {
+      return false;
+    }
+    node = *child;
+  }
+  return false;
+}
+
+SuccinctPathSet::const_iterator SuccinctPathSet::begin() const { return const_iterator(this); }
+
+SuccinctPathSet::const_iterator SuccinctPathSet::end() const { return const_iterator(); }
+
+SuccinctPathSet::const_iterator::const_iterator(const SuccinctPathSet *set) : set_(set) {
+  Enter(0);
+  if (set_->IsMember(0)) {
+    Materialize();
+  } else {
+    Advance();
+  }
+}
+
+void SuccinctPathSet::const_iterator::Enter(uint64_t node) {
+  const auto [first, count] = set_->Children(node);
+  stack_.push_back(Frame{first, first + count});
+  if (node != 0) {
+    components_.push_back(set_->LabelString(set_->Label(node)));
+  }
+}
+
+void SuccinctPathSet::const_iterator::Materialize() {
+  current_.emplace(components_, set_->is_absolute(), components_.empty());
+}
+
+void SuccinctPathSet::const_iterator::Advance() {
+  while (!stack_.empty()) {
+    Frame &top = stack_.back();
+    if (top.next_child < top.end_child) {
+      const uint64_t child = top.next_child++;
+      Enter(child);
+      if (set_->IsMember(child)) {
+        Materialize();
+        return;
+      }
+      continue;
+    }
+    stack_.pop_back();
+    if (!components_.empty()) {
+      components_.pop_back();
+    }
+  }
+  current_.reset();
+}
+
+SuccinctPathSet::const_iterator &SuccinctPathSet::const_iterator::operator++() {
+  Advance();
+  return *this;
+}
+
+}  // namespace spin_2_fs
+// vim: sw=2:sts=2:tw=100:et:cindent:cinoptions=l1,g1,h1,N-s,E-s,i2s,+2s,(0,w1,W2s
@@ -0,0 +1,167 @@
+// Copyright 2017 David Finkel
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef include_spin_2_fs_path_set_h
+#define include_spin_2_fs_path_set_h
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "path.h"
+
+namespace spin_2_fs {
+
+// SuccinctPathSet is an immutable set of Paths stored as a LOUDS-encoded trie over path components.
+//
+// Each trie node costs two bits of tree structure (plus a rank index), one bit marking whether it's
+// a member, and a fixed-width index into a front-coded, sorted dictionary of the distinct component
+// names. The whole set lives in one flat buffer, which can be written to a file and mmapped back
+// without any parsing. The buffer is in host byte order; loading one written on a machine of the
+// other byte order fails.
+//
+// All members must share absoluteness. Trailing slashes are not preserved: "/a" and "/a/" are the
+// same member, and iteration yields paths without one (apart from "/").
+class SuccinctPathSet {
+ public:
+  class const_iterator;
+
+  // Builds a set from paths sorted in Path::operator< order (duplicates are allowed). Returns
+  // std::nullopt if paths is unsorted or mixes absolute and relative paths.
+  static std::optional<SuccinctPathSet> Build(const std::vector<Path> &paths);
+  // Wraps a buffer holding serialized() output, without copying it. data must be 8-byte aligned
+  // and outlive the set (and its copies). Returns std::nullopt if the header and size don't
+  // describe a valid set, including one of the other byte order; the contents of the sections are
+  // trusted.
+  static std::optional<SuccinctPathSet> FromBuffer(std::string_view data);
+  // mmaps a file written by Save().
+  static std::optional<SuccinctPathSet> Load(const std::string &filename);
+
+  // The serialized form of the set, suitable for FromBuffer().
+  std::string_view serialized() const;
+  bool Save(const std::string &filename) const;
+
+  bool contains(const Path &path) const;
+  // Returns true if any member is strictly below dir.
+  bool contains_descendant_of(const Path &dir) const;
+  // Returns true if any member is a parent of path (in the sense of Path::has_parent()).
+  bool contains_ancestor_of(const Path &path) const;
+
+  bool is_absolute() const;
+  // Number of members.
+  uint64_t size() const;
+  // Number of trie nodes, which is at least size().
+  uint64_t num_nodes() const;
+
+  // Iterates over the members in Path::operator< order.
+  const_iterator begin() const;
+  const_iterator end() const;
+
+ private:
+  SuccinctPathSet() = default;
+  bool Init(std::shared_ptr<const void> owner, std::string_view data);
+
+  // Returns the node reached by following path's components from the root.
+  std::optional<uint64_t> Find(const Path &path) const;
+  // Returns the id of the node's first child and the number of children.
+  std::pair<uint64_t, uint64_t> Children(uint64_t node) const;
+  std::optional<uint64_t> FindChild(uint64_t node, uint64_t label) const;
+  std::optional<uint64_t> LookupLabel(std::string_view component) const;
+  uint64_t Label(uint64_t node) const;
+  // Returns the first name in a dictionary bucket, setting *next to the encoding of the second.
+  std::string_view BucketHead(uint64_t bucket, const char **next) const;
+  std::string LabelString(uint64_t label) const;
+  bool IsMember(uint64_t node) const;
+  uint64_t Rank1(uint64_t pos) const;
+  uint64_t Select0(uint64_t k) const;
+
+  // Keeps the buffer (owned vector or mapping) alive.
+  std::shared_ptr<const void> owner_;
+  std::string_view data_;
+  const uint64_t *header_ = nullptr;
+  const uint64_t *louds_ = nullptr;
+  uint64_t louds_words_ = 0;
+  const uint64_t *louds_rank_ = nullptr;
+  uint64_t louds_blocks_ = 0;
+  const uint64_t *members_ = nullptr;
+  const uint64_t *labels_ = nullptr;
+  uint64_t label_bits_ = 0;
+  const uint64_t *dict_offsets_ = nullptr;
+  const char *dict_bytes_ = nullptr;
+  uint64_t dict_size_ = 0;
+};
+
+// Input iterator over the members of a SuccinctPathSet, walking the trie depth-first.
+class SuccinctPathSet::const_iterator {
+ public:
+  using iterator_category = std::input_iterator_tag;
+  using value_type = Path;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const Path *;
+  using reference = const Path &;
+
+  const Path &operator*() const { return *current_; }
+  const Path *operator->() const { return &*current_; }
+  const_iterator &operator++();
+
+  // Only meaningful for comparing against end().
+  bool operator==(const const_iterator &other) const {
+    return stack_.empty() == other.stack_.empty();
+  }
+  bool operator!=(const const_iterator &other) const { return !(*this == other); }
+
+ private:
+  friend class SuccinctPathSet;
+  struct Frame {
+    uint64_t next_child;
+    uint64_t end_child;
+  };
+
+  const_iterator() = default;
+  explicit const_iterator(const SuccinctPathSet *set);
+  // Moves to the next member in pre-order, or to the end.
+  void Advance();
+  // Pushes node's children onto the stack and its name onto components_.
+  void Enter(uint64_t node);
+  // Sets current_ from components_.
+  void Materialize();
+
+  const SuccinctPathSet *set_ = nullptr;
+  std::vector<Frame> stack_;
+  std::vector<std::string> components_;
+  std::optional<Path> current_;
+};
+
+}  // namespace spin_2_fs
+
+#endif  // include_spin_2_fs_path_set_h
+// vim: sw=2:sts=2:tw=100:et:cindent:cinoptions=l1,g1,h1,N-s,E-s,i2s,+2s,(0,w1,W2s
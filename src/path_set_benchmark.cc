@@ -0,0 +1,101 @@
+// Copyright 2017 David Finkel
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "path_set.h"
+
+namespace spin_2_fs {
+namespace {
+
+constexpr int kNumPaths = 1000000;
+
+// 1M files spread over 100 top-level directories of 100 subdirectories each. Every file name is
+// distinct, which is the worst case for the component dictionary.
+const std::vector<Path> &Paths() {
+  static const std::vector<Path> *const paths = [] {
+    auto *paths = new std::vector<Path>();
+    paths->reserve(kNumPaths);
+    for (int i = 0; i < kNumPaths; i++) {
+      paths->push_back(Path("/src/dir" + std::to_string(i / 10000) + "/sub" +
+                            std::to_string(i / 100 % 100) + "/file" + std::to_string(i) + ".cc"));
+    }
+    std::sort(paths->begin(), paths->end());
+    return paths;
+  }();
+  return *paths;
+}
+
+const SuccinctPathSet &Set() {
+  static const SuccinctPathSet *const set = new SuccinctPathSet(*SuccinctPathSet::Build(Paths()));
+  return *set;
+}
+
+void BM_Build(benchmark::State &state) {
+  const std::vector<Path> &paths = Paths();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(SuccinctPathSet::Build(paths));
+  }
+  state.SetItemsProcessed(state.iterations() * paths.size());
+  state.counters["bytes_per_path"] =
+      static_cast<double>(Set().serialized().size()) / static_cast<double>(paths.size());
+}
+BENCHMARK(BM_Build)->Unit(benchmark::kMillisecond);
+
+// Looks up members in a scattered order, so that successive lookups don't share cache lines.
+void BM_ContainsHit(benchmark::State &state) {
+  const std::vector<Path> &paths = Paths();
+  const SuccinctPathSet &set = Set();
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(set.contains(paths[i]));
+    i = (i + 7919) % paths.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ContainsHit);
+
+// Misses in the last component, after walking the rest of the trie.
+void BM_ContainsMiss(benchmark::State &state) {
+  const SuccinctPathSet &set = Set();
+  const Path missing("/src/dir42/sub17/file_missing.cc");
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(set.contains(missing));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ContainsMiss);
+
+}  // anonymous namespace
+}  // namespace spin_2_fs
+
+BENCHMARK_MAIN();
+// vim: sw=2:sts=2:tw=100:et:cindent:cinoptions=l1,g1,h1,N-s,E-s,i2s,+2s,(0,w1,W2s
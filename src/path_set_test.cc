@@ -0,0 +1,226 @@
+// Copyright 2017 David Finkel
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <set>
+
+#include "path_set.h"
+
+namespace spin_2_fs {
+namespace {
+
+std::vector<Path> SortedPaths(const std::vector<std::string> &strs) {
+  std::vector<Path> paths;
+  for (const std::string &s : strs) {
+    paths.emplace_back(s);
+  }
+  std::sort(paths.begin(), paths.end());
+  return paths;
+}
+
+std::vector<std::string> Members(const SuccinctPathSet &set) {
+  std::vector<std::string> out;
+  for (const Path &p : set) {
+    out.push_back(p.to_string());
+  }
+  return out;
+}
+
+TEST(TestSuccinctPathSet, Empty) {
+  const std::optional<SuccinctPathSet> set = SuccinctPathSet::Build({});
+  ASSERT_TRUE(set.has_value());
+  EXPECT_EQ(0u, set->size());
+  EXPECT_FALSE(set->contains(Path("/")));
+  EXPECT_FALSE(set->contains(Path("/a")));
+  EXPECT_FALSE(set->contains_descendant_of(Path("/")));
+  EXPECT_THAT(Members(*set), testing::IsEmpty());
+}
+
+TEST(TestSuccinctPathSet, Membership) {
+  const std::optional<SuccinctPathSet> set = SuccinctPathSet::Build(
+      SortedPaths({"/usr/bin/ls", "/usr/bin/cat", "/usr/lib", "/etc/passwd", "/etc", "/var/"}));
+  ASSERT_TRUE(set.has_value());
+  EXPECT_TRUE(set->is_absolute());
+  EXPECT_EQ(6u, set->size());
+  // root, usr, bin, ls, cat, lib, etc, passwd, var
+  EXPECT_EQ(9u, set->num_nodes());
+  EXPECT_TRUE(set->contains(Path("/usr/bin/ls")));
+  EXPECT_TRUE(set->contains(Path("/usr/bin/cat")));
+  EXPECT_TRUE(set->contains(Path("/usr/lib/")));
+  EXPECT_TRUE(set->contains(Path("/etc")));
+  EXPECT_TRUE(set->contains(Path("/var")));
+  EXPECT_TRUE(set->contains(Path("/usr/bin/ls").parent().parent() / Path("lib")));
+  EXPECT_FALSE(set->contains(Path("/usr/bin")));
+  EXPECT_FALSE(set->contains(Path("/usr")));
+  EXPECT_FALSE(set->contains(Path("/")));
+  EXPECT_FALSE(set->contains(Path("/usr/bin/ls/x")));
+  EXPECT_FALSE(set->contains(Path("/usr/bin/cp")));
+  EXPECT_FALSE(set->contains(Path("/lib")));
+  EXPECT_FALSE(set->contains(Path("usr/bin/ls")));
+}
+
+TEST(TestSuccinctPathSet, Subtrees) {
+  const std::optional<SuccinctPathSet> set =
+      SuccinctPathSet::Build(SortedPaths({"/a/b/c", "/a/d", "/e"}));
+  ASSERT_TRUE(set.has_value());
+  EXPECT_TRUE(set->contains_descendant_of(Path("/")));
+  EXPECT_TRUE(set->contains_descendant_of(Path("/a")));
+  EXPECT_TRUE(set->contains_descendant_of(Path("/a/b")));
+  EXPECT_FALSE(set->contains_descendant_of(Path("/a/b/c")));
+  EXPECT_FALSE(set->contains_descendant_of(Path("/e")));
+  EXPECT_FALSE(set->contains_descendant_of(Path("/x")));
+
+  EXPECT_TRUE(set->contains_ancestor_of(Path("/a/d/x/y")));
+  EXPECT_TRUE(set->contains_ancestor_of(Path("/e/f")));
+  EXPECT_FALSE(set->contains_ancestor_of(Path("/e")));
+  EXPECT_FALSE(set->contains_ancestor_of(Path("/a/b")));
+  EXPECT_FALSE(set->contains_ancestor_of(Path("/a/b/d")));
+}
+
+TEST(TestSuccinctPathSet, Relative) {
+  const std::optional<SuccinctPathSet> set =
+      SuccinctPathSet::Build(SortedPaths({".", "../x", "a/b", "a"}));
+  ASSERT_TRUE(set.has_value());
+  EXPECT_FALSE(set->is_absolute());
+  EXPECT_TRUE(set->contains(Path(".")));
+  EXPECT_TRUE(set->contains(Path("../x")));
+  EXPECT_TRUE(set->contains(Path("a/b")));
+  EXPECT_FALSE(set->contains(Path("/a/b")));
+  EXPECT_TRUE(set->contains_ancestor_of(Path("q")));
+  EXPECT_THAT(Members(*set), testing::ElementsAre(".", "../x", "a", "a/b"));
+}
+
+TEST(TestSuccinctPathSet, RejectsBadInput) {
+  EXPECT_FALSE(SuccinctPathSet::Build({Path("/b"), Path("/a")}).has_value());
+  EXPECT_FALSE(SuccinctPathSet::Build({Path("/a"), Path("b")}).has_value());
+  EXPECT_TRUE(SuccinctPathSet::Build({Path("/a"), Path("/a")}).has_value());
+}
+
+TEST(TestSuccinctPathSet, LargeSetMatchesStdSet) {
+  std::vector<std::string> strs;
+  for (int i = 0; i < 3000; i++) {
+    const int a = (i * 7919) % 31;
+    const int b = (i * 104729) % 97;
+    std::string s = "/top" + std::to_string(a) + "/mid" + std::to_string(b);
+    if (i % 3 != 0) {
+      s += "/leaf" + std::to_string(i);
+    }
+    strs.push_back(s);
+  }
+  std::vector<Path> paths = SortedPaths(strs);
+  const std::optional<SuccinctPathSet> set = SuccinctPathSet::Build(paths);
+  ASSERT_TRUE(set.has_value());
+
+  std::set<std::string> unique;
+  std::vector<std::string> expected;
+  for (const Path &p : paths) {
+    if (unique.insert(p.to_string()).second) {
+      expected.push_back(p.to_string());
+    }
+  }
+  EXPECT_EQ(expected.size(), set->size());
+  EXPECT_EQ(expected, Members(*set));
+  for (const Path &p : paths) {
+    EXPECT_TRUE(set->contains(p)) << p;
+    EXPECT_FALSE(set->contains(p / Path("missing"))) << p;
+  }
+  EXPECT_FALSE(set->contains(Path("/top1")));
+  EXPECT_TRUE(set->contains_descendant_of(Path("/top1")));
+}
+
+TEST(TestSuccinctPathSet, ShortNames) {
+  // Short distinct names make the dictionary hold more names than the buffer has words.
+  for (const int n : {100, 1000, 100000}) {
+    std::vector<std::string> strs;
+    for (int i = 0; i < n; i++) {
+      strs.push_back("/d/" + std::to_string(i));
+    }
+    const std::optional<SuccinctPathSet> set = SuccinctPathSet::Build(SortedPaths(strs));
+    ASSERT_TRUE(set.has_value()) << n;
+    EXPECT_EQ(static_cast<uint64_t>(n), set->size());
+    EXPECT_TRUE(set->contains(Path("/d/0")));
+    EXPECT_TRUE(set->contains(Path("/d/" + std::to_string(n - 1))));
+    EXPECT_FALSE(set->contains(Path("/d/" + std::to_string(n))));
+
+    const std::string_view bytes = set->serialized();
+    const std::optional<SuccinctPathSet> from_buffer = SuccinctPathSet::FromBuffer(bytes);
+    ASSERT_TRUE(from_buffer.has_value()) << n;
+    EXPECT_EQ(set->size(), from_buffer->size());
+  }
+}
+
+TEST(TestSuccinctPathSet, SerializeAndLoad) {
+  const std::optional<SuccinctPathSet> set =
+      SuccinctPathSet::Build(SortedPaths({"/a/b/c", "/a/d", "/e", "/f/g/h/i"}));
+  ASSERT_TRUE(set.has_value());
+
+  // From an in-memory copy of the buffer.
+  const std::string_view bytes = set->serialized();
+  std::vector<uint64_t> copy(bytes.size() / sizeof(uint64_t));
+  std::copy(bytes.begin(), bytes.end(), reinterpret_cast<char *>(copy.data()));
+  const char *data = reinterpret_cast<const char *>(copy.data());
+  const std::optional<SuccinctPathSet> from_buffer =
+      SuccinctPathSet::FromBuffer(std::string_view(data, bytes.size()));
+  ASSERT_TRUE(from_buffer.has_value());
+  EXPECT_EQ(Members(*set), Members(*from_buffer));
+  EXPECT_TRUE(from_buffer->contains(Path("/f/g/h/i")));
+
+  // Through a file.
+  char name[] = "/tmp/path_set_test.XXXXXX";
+  const int fd = mkstemp(name);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  ASSERT_TRUE(set->Save(name));
+  const std::optional<SuccinctPathSet> loaded = SuccinctPathSet::Load(name);
+  unlink(name);
+  ASSERT_TRUE(loaded.has_value());
+  EXPECT_EQ(Members(*set), Members(*loaded));
+  EXPECT_TRUE(loaded->contains(Path("/a/d")));
+  EXPECT_FALSE(loaded->contains(Path("/a")));
+
+  // Corrupt or truncated buffers are rejected.
+  copy[0] ^= 1;
+  EXPECT_FALSE(SuccinctPathSet::FromBuffer(std::string_view(data, bytes.size())).has_value());
+  copy[0] ^= 1;
+  EXPECT_FALSE(SuccinctPathSet::FromBuffer(std::string_view(data, bytes.size() - 8)).has_value());
+
+  // As is a set written on a machine of the other byte order.
+  for (uint64_t &word : copy) {
+    word = __builtin_bswap64(word);
+  }
+  EXPECT_FALSE(SuccinctPathSet::FromBuffer(std::string_view(data, bytes.size())).has_value());
+}
+
+}  // anonymous namespace
+}  // namespace spin_2_fs
+// vim: sw=2:sts=2:tw=100:et:cindent:cinoptions=l1,g1,h1,N-s,E-s,i2s,+2s,(0,w1,W2s
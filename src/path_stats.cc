@@ -0,0 +1,206 @@
+// Copyright 2017 David Finkel
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "path_stats.h"
+
+#include <atomic>
+#include <mutex>
+#include <unordered_set>
+
+namespace spin_2_fs {
+
+namespace {
+
+// Counters for a single thread. Only the owning thread ever writes to these, so increments are a
+// relaxed load and store rather than a read-modify-write; the atomics only exist so that
+// GetPathStats() can read them from another thread without a data race.
+struct ThreadPathStats {
+  std::atomic<uint64_t> counts[kNumPathOps] = {};
+  std::atomic<uint64_t> nanos[kNumPathOps] = {};
+  std::atomic<uint64_t> buckets[kNumPathOps][kNumLatencyBuckets] = {};
+  std::atomic<uint64_t> parent_rebuilds{0};
+  std::atomic<uint64_t> storage_allocations{0};
+  std::atomic<uint64_t> storage_bytes{0};
+};
+
+inline void Bump(std::atomic<uint64_t> *counter, uint64_t delta) {
+  counter->store(counter->load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+void Accumulate(const ThreadPathStats &from, PathStats *to) {
+  for (int op = 0; op < kNumPathOps; op++) {
+    PathOpStats &op_stats = to->ops[op];
+    op_stats.count += from.counts[op].load(std::memory_order_relaxed);
+    op_stats.total_nanos += from.nanos[op].load(std::memory_order_relaxed);
+    for (int b = 0; b < kNumLatencyBuckets; b++) {
+      op_stats.latency_buckets[b] += from.buckets[op][b].load(std::memory_order_relaxed);
+    }
+  }
+  to->parent_rebuilds += from.parent_rebuilds.load(std::memory_order_relaxed);
+  to->storage_allocations += from.storage_allocations.load(std::memory_order_relaxed);
+  to->storage_bytes += from.storage_bytes.load(std::memory_order_relaxed);
+}
+
+// Tracks the counters of live threads, and the totals of threads that have exited.
+struct Registry {
+  std::mutex mu;
+  std::unordered_set<const ThreadPathStats *> live;
+  PathStats retired;
+};
+
+Registry &GetRegistry() {
+  // Intentionally leaked so that it outlives the thread_local destructors of the last threads.
+  static Registry *registry = new Registry;
+  return *registry;
+}
+
+// Registers a thread's counters on first use and folds them into the retired totals when the
+// thread exits.
+class ThreadSlot {
+ public:
+  ThreadSlot() {
+    Registry &registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mu);
+    registry.live.insert(&stats_);
+  }
+  ~ThreadSlot() {
+    Registry &registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mu);
+    registry.live.erase(&stats_);
+    Accumulate(stats_, &registry.retired);
+  }
+  ThreadPathStats *stats() { return &stats_; }
+
+ private:
+  ThreadPathStats stats_;
+};
+
+ThreadPathStats *LocalStats() {
+  thread_local ThreadSlot slot;
+  return slot.stats();
+}
+
+int LatencyBucket(uint64_t nanos) {
+  if (nanos <= 1) {
+    return 0;
+  }
+  // ceil(log2(nanos))
+  const int bucket = 64 - __builtin_clzll(nanos - 1);
+  return bucket < kNumLatencyBuckets ? bucket : kNumLatencyBuckets - 1;
+}
+
+}  // anonymous namespace
+
+const char *PathOpName(PathOp op) {
+  switch (op) {
+    case PathOp::kConstruct:
+      return "construct";
+    case PathOp::kCanonicalize:
+      return "canonicalize";
+    case PathOp::kJoin:
+      return "join";
+    case PathOp::kToString:
+      return "to_string";
+    case PathOp::kParent:
+      return "parent";
+  }
+  return "unknown";
+}
+
+PathStats GetPathStats() {
+  Registry &registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mu);
+  PathStats stats = registry.retired;
+  for (const ThreadPathStats *thread_stats : registry.live) {
+    Accumulate(*thread_stats, &stats);
+  }
+  return stats;
+}
+
+void WritePathStats(const PathStats &stats, std::ostream *out) {
+  *out << "# TYPE spin_2_fs_path_op_latency_nanos histogram\n";
+  for (int op = 0; op < kNumPathOps; op++) {
+    const PathOpStats &op_stats = stats.ops[op];
+    const char *name = PathOpName(static_cast<PathOp>(op));
+    uint64_t cumulative = 0;
+    for (int b = 0; b < kNumLatencyBuckets - 1; b++) {
+      cumulative += op_stats.latency_buckets[b];
+      *out << "spin_2_fs_path_op_latency_nanos_bucket{op=\"" << name << "\",le=\""
+           << (uint64_t{1} << b) << "\"} " << cumulative << "\n";
+    }
+    *out << "spin_2_fs_path_op_latency_nanos_bucket{op=\"" << name << "\",le=\"+Inf\"} "
+         << op_stats.count << "\n";
+    *out << "spin_2_fs_path_op_latency_nanos_sum{op=\"" << name << "\"} " << op_stats.total_nanos
+         << "\n";
+    *out << "spin_2_fs_path_op_latency_nanos_count{op=\"" << name << "\"} " << op_stats.count
+         << "\n";
+  }
+  *out << "# TYPE spin_2_fs_path_parent_rebuilds_total counter\n"
+       << "spin_2_fs_path_parent_rebuilds_total " << stats.parent_rebuilds << "\n";
+  *out << "# TYPE spin_2_fs_path_storage_allocations_total counter\n"
+       << "spin_2_fs_path_storage_allocations_total " << stats.storage_allocations << "\n";
+  *out << "# TYPE spin_2_fs_path_storage_bytes_total counter\n"
+       << "spin_2_fs_path_storage_bytes_total " << stats.storage_bytes << "\n";
+}
+
+namespace path_stats_internal {
+
+void RecordOp(PathOp op, uint64_t nanos) {
+  ThreadPathStats *stats = LocalStats();
+  const int i = static_cast<int>(op);
+  Bump(&stats->counts[i], 1);
+  Bump(&stats->nanos[i], nanos);
+  Bump(&stats->buckets[i][LatencyBucket(nanos)], 1);
+}
+
+void RecordParentRebuild() { Bump(&LocalStats()->parent_rebuilds, 1); }
+
+void RecordStorage(const std::vector<std::string> &components) {
+  // One allocation for the refcounted block holding the vector, one for the vector's buffer and one
+  // for each component that doesn't fit in the small-string buffer.
+  static const size_t kInlineCapacity = std::string().capacity();
+  uint64_t allocations = 1;
+  uint64_t bytes = sizeof(components);
+  if (components.capacity() > 0) {
+    allocations++;
+    bytes += components.capacity() * sizeof(std::string);
+  }
+  for (const std::string &c : components) {
+    if (c.capacity() > kInlineCapacity) {
+      allocations++;
+      bytes += c.capacity() + 1;
+    }
+  }
+  ThreadPathStats *stats = LocalStats();
+  Bump(&stats->storage_allocations, allocations);
+  Bump(&stats->storage_bytes, bytes);
+}
+
+}  // namespace path_stats_internal
+
+}  // namespace spin_2_fs
+// vim: sw=2:sts=2:tw=100:et:cindent:cinoptions=l1,g1,h1,N-s,E-s,i2s,+2s,(0,w1,W2s
@@ -0,0 +1,133 @@
+// Copyright 2017 David Finkel
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef include_spin_2_fs_path_stats_h
+#define include_spin_2_fs_path_stats_h
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace spin_2_fs {
+
+// Optional instrumentation for the Path hot paths. The recording hooks in path.cc are compiled in
+// only when SPIN_2_FS_PATH_STATS is defined (`bazel build --define path_stats=1`); otherwise the
+// hooks expand to nothing and GetPathStats() always returns zeros.
+//
+// Counters are kept per-thread and only ever written by their owning thread, so recording an
+// operation never touches a shared cache line. Exited threads fold their counters into a global
+// total, so the values returned by GetPathStats() are monotonic.
+
+// Operations that are counted and timed. Timings are inclusive: kConstruct and kJoin both include
+// the time spent in kCanonicalize.
+enum class PathOp : int {
+  kConstruct = 0,  // Path(std::string_view), including parsing.
+  kCanonicalize,   // Collapsing ".", ".." and empty components.
+  kJoin,           // Join() and operator/.
+  kToString,       // to_string().
+  kParent,         // parent().
+};
+constexpr int kNumPathOps = 5;
+
+// Latency histograms use power-of-two buckets: bucket i counts operations that took
+// (2^(i-1), 2^i] nanoseconds (bucket 0 counts 0 and 1ns), and the last bucket is open-ended. Upper
+// bounds are inclusive so that they can be exported as Prometheus "le" labels as they are.
+constexpr int kNumLatencyBuckets = 32;
+
+// Returns a short lower-case name for op, suitable for use as a metric label.
+const char *PathOpName(PathOp op);
+
+struct PathOpStats {
+  uint64_t count = 0;
+  uint64_t total_nanos = 0;
+  std::array<uint64_t, kNumLatencyBuckets> latency_buckets{};
+};
+
+struct PathStats {
+  std::array<PathOpStats, kNumPathOps> ops{};
+  // Number of times parent() had to allocate new component storage because the path was relative
+  // and consisted only of ".." components.
+  uint64_t parent_rebuilds = 0;
+  // Heap allocations made for component storage (the shared vector, its buffer and any component
+  // strings too long for the small-string buffer), and their approximate size in bytes.
+  uint64_t storage_allocations = 0;
+  uint64_t storage_bytes = 0;
+
+  const PathOpStats &op(PathOp o) const { return ops[static_cast<int>(o)]; }
+};
+
+// Returns the sum of the counters of every thread that has recorded anything, including threads
+// that have since exited.
+PathStats GetPathStats();
+
+// Writes stats in the Prometheus text exposition format.
+void WritePathStats(const PathStats &stats, std::ostream *out);
+
+namespace path_stats_internal {
+
+void RecordOp(PathOp op, uint64_t nanos);
+void RecordParentRebuild();
+void RecordStorage(const std::vector<std::string> &components);
+
+// Records the lifetime of the enclosing scope as one call of op.
+class ScopedOpTimer {
+ public:
+  explicit ScopedOpTimer(PathOp op) : op_(op), start_(std::chrono::steady_clock::now()) {}
+  ScopedOpTimer(const ScopedOpTimer &) = delete;
+  ScopedOpTimer &operator=(const ScopedOpTimer &) = delete;
+  ~ScopedOpTimer() {
+    const auto elapsed = std::chrono::steady_clock::now() - start_;
+    RecordOp(op_, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+  }
+
+ private:
+  const PathOp op_;
+  const std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace path_stats_internal
+
+#ifdef SPIN_2_FS_PATH_STATS
+#define SPIN_2_FS_PATH_OP_TIMER(op) \
+  ::spin_2_fs::path_stats_internal::ScopedOpTimer spin_2_fs_path_op_timer(op)
+#define SPIN_2_FS_PATH_RECORD_PARENT_REBUILD() \
+  ::spin_2_fs::path_stats_internal::RecordParentRebuild()
+#define SPIN_2_FS_PATH_RECORD_STORAGE(components) \
+  ::spin_2_fs::path_stats_internal::RecordStorage(components)
+#else
+#define SPIN_2_FS_PATH_OP_TIMER(op)
+#define SPIN_2_FS_PATH_RECORD_PARENT_REBUILD()
+#define SPIN_2_FS_PATH_RECORD_STORAGE(components)
+#endif
+
+}  // namespace spin_2_fs
+
+#endif  // include_spin_2_fs_path_stats_h
+// vim: sw=2:sts=2:tw=100:et:cindent:cinoptions=l1,g1,h1,N-s,E-s,i2s,+2s,(0,w1,W2s
@@ -0,0 +1,135 @@
+// Copyright 2017 David Finkel
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include <sstream>
+#include <thread>
+
+#include "path.h"
+#include "path_stats.h"
+
+namespace spin_2_fs {
+namespace {
+
+TEST(TestPathStats, RecordOp) {
+  const PathStats before = GetPathStats();
+  path_stats_internal::RecordOp(PathOp::kJoin, 0);
+  path_stats_internal::RecordOp(PathOp::kJoin, 2);
+  path_stats_internal::RecordOp(PathOp::kJoin, 3);
+  path_stats_internal::RecordOp(PathOp::kJoin, 4);
+  path_stats_internal::RecordOp(PathOp::kJoin, 1000);
+  path_stats_internal::RecordOp(PathOp::kJoin, 1025);
+  const PathStats after = GetPathStats();
+
+  const PathOpStats &b = before.op(PathOp::kJoin);
+  const PathOpStats &a = after.op(PathOp::kJoin);
+  EXPECT_EQ(b.count + 6, a.count);
+  EXPECT_EQ(b.total_nanos + 2034, a.total_nanos);
+  EXPECT_EQ(b.latency_buckets[0] + 1, a.latency_buckets[0]);
+  // Upper bounds are inclusive: 2 is in (1, 2], and 3 and 4 are in (2, 4].
+  EXPECT_EQ(b.latency_buckets[1] + 1, a.latency_buckets[1]);
+  EXPECT_EQ(b.latency_buckets[2] + 2, a.latency_buckets[2]);
+  // 512 < 1000 <= 1024 < 1025
+  EXPECT_EQ(b.latency_buckets[10] + 1, a.latency_buckets[10]);
+  EXPECT_EQ(b.latency_buckets[11] + 1, a.latency_buckets[11]);
+  EXPECT_EQ(before.op(PathOp::kParent).count, after.op(PathOp::kParent).count);
+}
+
+TEST(TestPathStats, LongLatencyClamped) {
+  const PathStats before = GetPathStats();
+  path_stats_internal::RecordOp(PathOp::kToString, ~uint64_t{0});
+  const PathStats after = GetPathStats();
+  EXPECT_EQ(before.op(PathOp::kToString).latency_buckets[kNumLatencyBuckets - 1] + 1,
+            after.op(PathOp::kToString).latency_buckets[kNumLatencyBuckets - 1]);
+}
+
+TEST(TestPathStats, ExitedThreadsAreRetained) {
+  const PathStats before = GetPathStats();
+  std::thread t([] {
+    path_stats_internal::RecordOp(PathOp::kParent, 10);
+    path_stats_internal::RecordParentRebuild();
+    path_stats_internal::RecordStorage({"foo", std::string(100, 'x')});
+  });
+  t.join();
+  const PathStats after = GetPathStats();
+  EXPECT_EQ(before.op(PathOp::kParent).count + 1, after.op(PathOp::kParent).count);
+  EXPECT_EQ(before.parent_rebuilds + 1, after.parent_rebuilds);
+  // storage block + vector buffer + the long component.
+  EXPECT_EQ(before.storage_allocations + 3, after.storage_allocations);
+  EXPECT_LT(before.storage_bytes + 100, after.storage_bytes);
+}
+
+TEST(TestPathStats, Export) {
+  PathStats stats;
+  stats.ops[static_cast<int>(PathOp::kConstruct)].count = 2;
+  stats.ops[static_cast<int>(PathOp::kConstruct)].total_nanos = 6;
+  stats.ops[static_cast<int>(PathOp::kConstruct)].latency_buckets[1] = 1;
+  stats.ops[static_cast<int>(PathOp::kConstruct)].latency_buckets[2] = 1;
+  stats.parent_rebuilds = 4;
+  std::ostringstream out;
+  WritePathStats(stats, &out);
+  const std::string text = out.str();
+  const std::string latency = "spin_2_fs_path_op_latency_nanos_";
+  const std::string bucket = latency + "bucket{op=\"construct\",";
+  // Bucket 1 holds ops of exactly 2ns and bucket 2 ops of 3-4ns.
+  EXPECT_THAT(text, testing::HasSubstr(bucket + "le=\"1\"} 0\n"));
+  EXPECT_THAT(text, testing::HasSubstr(bucket + "le=\"2\"} 1\n"));
+  EXPECT_THAT(text, testing::HasSubstr(bucket + "le=\"4\"} 2\n"));
+  EXPECT_THAT(text, testing::HasSubstr(bucket + "le=\"8\"} 2\n"));
+  EXPECT_THAT(text, testing::HasSubstr(bucket + "le=\"+Inf\"} 2\n"));
+  EXPECT_THAT(text, testing::HasSubstr(latency + "sum{op=\"construct\"} 6\n"));
+  EXPECT_THAT(text, testing::HasSubstr("spin_2_fs_path_parent_rebuilds_total 4\n"));
+}
+
+TEST(TestPathStats, PathHooks) {
+  const PathStats before = GetPathStats();
+  const Path foo("../../foo/bar");
+  const Path up = Path("..").parent();
+  const std::string s = (foo / Path("baz")).parent().to_string();
+  const PathStats after = GetPathStats();
+#ifdef SPIN_2_FS_PATH_STATS
+  EXPECT_EQ(before.op(PathOp::kConstruct).count + 3, after.op(PathOp::kConstruct).count);
+  // Once for each constructor, and once more for the Join.
+  EXPECT_EQ(before.op(PathOp::kCanonicalize).count + 4, after.op(PathOp::kCanonicalize).count);
+  EXPECT_EQ(before.op(PathOp::kJoin).count + 1, after.op(PathOp::kJoin).count);
+  EXPECT_EQ(before.op(PathOp::kParent).count + 2, after.op(PathOp::kParent).count);
+  EXPECT_EQ(before.op(PathOp::kToString).count + 1, after.op(PathOp::kToString).count);
+  EXPECT_EQ(before.parent_rebuilds + 1, after.parent_rebuilds);
+  EXPECT_LT(before.storage_allocations, after.storage_allocations);
+#else
+  // The hooks are compiled out, so nothing should have been recorded.
+  EXPECT_EQ(before.op(PathOp::kConstruct).count, after.op(PathOp::kConstruct).count);
+  EXPECT_EQ(before.parent_rebuilds, after.parent_rebuilds);
+  EXPECT_EQ(before.storage_allocations, after.storage_allocations);
+#endif
+}
+
+}  // anonymous namespace
+}  // namespace spin_2_fs
+// vim: sw=2:sts=2:tw=100:et:cindent:cinoptions=l1,g1,h1,N-s,E-s,i2s,+2s,(0,w1,W2s
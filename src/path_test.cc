@@ -193,6 +193,84 @@ TEST(TestPath, TestLastComponent) {
   EXPECT_EQ(dne, "bim");
 }
 
+TEST(TestPath, TestEquality) {
+  EXPECT_EQ(Path("/foo/bar"), Path("/foo/bim/../bar"));
+  EXPECT_NE(Path("/foo/bar"), Path("/foo/bim"));
+  EXPECT_NE(Path("/foo/bar"), Path("/foo/bar/"));
+  EXPECT_NE(Path("/foo/bar"), Path("foo/bar"));
+  // Same length and flags, differing only past the first component.
+  EXPECT_NE(Path("/usr/lib/libc.so"), Path("/usr/lib/libm.so"));
+  EXPECT_NE(Path("a/b/c/d"), Path("a/b/x/d"));
+  EXPECT_NE(Path("/foo/bar/bim"), Path("/foo/baz/bim"));
+  EXPECT_EQ(Path("/foo/bar/bim").parent(), Path("/foo/bar/"));
+  EXPECT_NE(Path("/foo/bar/bim").parent(), Path("/foo/bim/"));
+}
+
+TEST(TestPath, TestComponents) {
+  const Path foo("/bim/bar/foo");
+  ASSERT_EQ(3, foo.num_components());
+  EXPECT_EQ("bim", foo.component(0));
+  EXPECT_EQ("foo", foo.component(2));
+  EXPECT_EQ(2, foo.parent().num_components());
+  EXPECT_EQ(0, Path::Root().num_components());
+  EXPECT_EQ(0, Path(".").num_components());
+  EXPECT_EQ("..", Path("../a").component(0));
+}
+
+TEST(TestPath, TestDerivedPaths) {
+  // Paths sharing storage with a longer path must only see their own components.
+  const Path foo("/bim/bar/foo");
+  EXPECT_EQ("bar", foo.parent().last_component());
+  EXPECT_EQ(Path("bar/"), foo.parent().make_relative(Path("/bim")).value());
+}
+
+TEST(TestLocalPath, SameBehaviour) {
+  const LocalPath fim("/foo/bar/fim");
+  EXPECT_EQ("/foo/bar/", fim.parent().to_string());
+  EXPECT_TRUE(fim.parent().parent().parent().is_root());
+  EXPECT_TRUE(fim.has_parent(fim.parent().parent()));
+  EXPECT_EQ("/foo/boo", (fim / LocalPath("../../boo")).to_string());
+  EXPECT_EQ("../../", LocalPath("").parent().parent().to_string());
+  EXPECT_TRUE(LocalPath("/a") < LocalPath("/a/b"));
+  EXPECT_EQ(LocalPath::Root(), LocalPath("/"));
+
+  // Copies share storage and keep it alive.
+  std::optional<LocalPath> copy;
+  {
+    const LocalPath tmp("/x/y/z");
+    copy = tmp.parent();
+  }
+  EXPECT_EQ("/x/y/", copy->to_string());
+}
+
+TEST(TestLocalPath, Conversion) {
+  const Path shared("../foo/bar/");
+  const LocalPath local(shared);
+  EXPECT_EQ("../foo/bar/", local.to_string());
+  EXPECT_FALSE(local.is_absolute());
+  const Path back(local.parent());
+  EXPECT_EQ(Path("../foo/"), back);
+  EXPECT_EQ(2, back.num_components());
+}
+
+// A moved-from path may still be copied, assigned from and assigned to.
+template <typename P>
+void CheckMovedFrom() {
+  P from("/a/b");
+  const P to(std::move(from));
+  EXPECT_EQ("/a/b", to.to_string());
+  P copy(from);
+  P assigned("/c");
+  assigned = from;
+  copy = to;
+  from = to;
+  EXPECT_EQ(to, from);
+  EXPECT_EQ("/a/b", copy.to_string());
+}
+
+TEST(TestPath, MovedFrom) { CheckMovedFrom<Path>(); }
+TEST(TestLocalPath, MovedFrom) { CheckMovedFrom<LocalPath>(); }
+
 TEST(TestCanonical, TooManyDots) {
   constexpr bool f = is_canonical("./././");
   static_assert(!f, "`./././` is not a valid path, but is_canonical() returned true");
@@ -27,10 +27,13 @@
 
 #include "strings.h"
 
+#include <algorithm>
+
 namespace spin_2_fs {
 
-std::vector<std::string> SplitStrings(const std::string &in, char sep) {
+std::vector<std::string> SplitStrings(std::string_view in, char sep) {
   std::vector<std::string> components;
+  components.reserve(std::count(in.begin(), in.end(), sep) + 1);
   auto sep_iter = in.begin();
   for (auto it = in.begin(); it != in.end(); it++) {
     if (*it == sep) {
@@ -29,10 +29,11 @@
 #define include_spin_2_fs_strings_h
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace spin_2_fs {
-std::vector<std::string> SplitStrings(const std::string &in, char sep);
+std::vector<std::string> SplitStrings(std::string_view in, char sep);
 
 }  // namespace spin_2_fs
 
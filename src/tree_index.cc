@@ -0,0 +1,840 @@
+// Copyright 2017 David Finkel
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "tree_index.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <utility>
+
+namespace spin_2_fs {
+
+struct TreeIndex::Dir {
+  struct Entry {
+    std::string name;
+    bool is_dir;
+    // Null for anything but a directory.
+    std::shared_ptr<Dir> dir;
+  };
+  // A run of consecutive entries. Chunks are shared between copies of a directory like directories
+  // are between trees, so changing an entry copies only its chunk.
+  struct Chunk {
+    uint64_t generation = 0;
+    // Sorted by name, and never empty.
+    std::vector<Entry> entries;
+  };
+
+  // Returns the entry named name, or nullptr.
+  const Entry *Find(std::string_view name) const;
+  // As Find(), but first copies the entry's chunk unless it was already copied in generation.
+  Entry *MutableFind(std::string_view name, uint64_t generation);
+  // Adds an entry that sorts after all the others.
+  void Append(Entry entry, uint64_t generation);
+  void Insert(Entry entry, uint64_t generation);
+  void Erase(std::string_view name, uint64_t generation);
+  // Calls fn with each entry in order.
+  template <typename Fn>
+  void ForEach(Fn fn) const {
+    for (const auto &chunk : chunks) {
+      for (const Entry &entry : chunk->entries) {
+        fn(entry);
+      }
+    }
+  }
+
+  // Returns the index of the chunk that holds name, or that it would be inserted into. There must
+  // be at least one chunk.
+  size_t ChunkFor(std::string_view name) const;
+  // Returns chunks[i], first copying it unless it was already copied in generation.
+  Chunk *OwnChunk(size_t i, uint64_t generation);
+
+  uint64_t generation = 0;
+  // Number of entries below this directory.
+  uint64_t size = 0;
+  // Sorted by name.
+  std::vector<std::shared_ptr<Chunk>> chunks;
+};
+
+struct TreeIndex::HazardSlot {
+  std::atomic<bool> in_use{false};
+  // The snapshot the slot's reader is using, which mustn't be freed.
+  std::atomic<const Snapshot *> snapshot{nullptr};
+  HazardSlot *next = nullptr;
+};
+
+namespace {
+
+// Entry creations, deletions and renames; changes to contents and metadata don't affect the index.
+constexpr uint32_t kWatchMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR |
+                                IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+
+constexpr size_t kEventBufferSize = 64 * 1024;
+
+// Chunks are split when they grow past this many entries, and merged with a neighbour when they
+// shrink below a quarter of it, so that a change copies a bounded number of entries and a copy of a
+// directory a bounded fraction of its size.
+constexpr size_t kChunkSize = 128;
+
+// Directory mtimes only advance once per kernel clock tick (or far less often on some
+// filesystems), so a directory changed just after it was read can still have the mtime that was
+// recorded. Directories whose mtime was this recent when read are re-read by every rescan.
+constexpr time_t kRacySeconds = 2;
+
+bool IsRacy(const timespec &mtime) {
+  timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return mtime.tv_sec + kRacySeconds >= now.tv_sec;
+}
+
+bool SameTime(const timespec &a, const timespec &b) {
+  return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+struct Listed {
+  std::string name;
+  bool is_dir;
+};
+
+// Reads the names and types of the entries of the directory at path, sorted by name.
+bool ListDir(const char *path, std::vector<Listed> *listing) {
+  DIR *dir = opendir(path);
+  if (dir == nullptr) {
+    return false;
+  }
+  while (const dirent *entry = readdir(dir)) {
+    const std::string_view name(entry->d_name);
+    if (name == "." || name == "..") {
+      continue;
+    }
+    bool is_dir = entry->d_type == DT_DIR;
+    if (entry->d_type == DT_UNKNOWN) {
+      struct stat st;
+      if (fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+        continue;
+      }
+      is_dir = S_ISDIR(st.st_mode);
+    }
+    listing->push_back({std::string(name), is_dir});
+  }
+  closedir(dir);
+  std::sort(listing->begin(), listing->end(),
+            [](const Listed &a, const Listed &b) { return a.name < b.name; });
+  return true;
+}
+
+// Returns the entry named name in a sorted vector of entries, or entries.end().
+template <typename Entries>
+auto FindEntry(Entries &entries, std::string_view name) -> decltype(entries.begin()) {
+  auto it = std::lower_bound(entries.begin(), entries.end(), name,
+                             [](const auto &entry, std::string_view n) { return entry.name < n; });
+  return it != entries.end() && it->name == name ? it : entries.end();
+}
+
+// Splits a path relative to the root into its parent's and its own name.
+std::string_view ParentName(std::string_view rel) {
+  const size_t slash = rel.rfind('/');
+  return slash == std::string_view::npos ? std::string_view() : rel.substr(0, slash);
+}
+
+std::string_view BaseName(std::string_view rel) { return rel.substr(rel.rfind('/') + 1); }
+
+// Calls fn with each component of a path relative to the root, stopping if it returns false.
+template <typename Fn>
+bool ForEachComponent(std::string_view rel, Fn fn) {
+  while (!rel.empty()) {
+    const size_t slash = rel.find('/');
+    if (!fn(rel.substr(0, slash))) {
+      return false;
+    }
+    rel = slash == std::string_view::npos ? std::string_view() : rel.substr(slash + 1);
+  }
+  return true;
+}
+
+size_t Depth(const std::string &rel) { return std::count(rel.begin(), rel.end(), '/'); }
+
+}  // anonymous namespace
+
+const TreeIndex::Dir::Entry *TreeIndex::Dir::Find(std::string_view name) const {
+  if (chunks.empty()) {
+    return nullptr;
+  }
+  const std::vector<Entry> &entries = chunks[ChunkFor(name)]->entries;
+  auto entry = FindEntry(entries, name);
+  return entry != entries.end() ? &*entry : nullptr;
+}
+
+TreeIndex::Dir::Entry *TreeIndex::Dir::MutableFind(std::string_view name, uint64_t generation) {
+  if (Find(name) == nullptr) {
+    return nullptr;
+  }
+  std::vector<Entry> &entries = OwnChunk(ChunkFor(name), generation)->entries;
+  return &*FindEntry(entries, name);
+}
+
+void TreeIndex::Dir::Append(Entry entry, uint64_t generation) {
+  if (chunks.empty() || chunks.back()->entries.size() >= kChunkSize) {
+    chunks.push_back(std::make_shared<Chunk>());
+    chunks.back()->generation = generation;
+    chunks.back()->entries.reserve(kChunkSize);
+  }
+  chunks.back()->entries.push_back(std::move(entry));
+}
+
+void TreeIndex::Dir::Insert(Entry entry, uint64_t generation) {
+  if (chunks.empty()) {
+    Append(std::move(entry), generation);
+    return;
+  }
+  const size_t i = ChunkFor(entry.name);
+  std::vector<Entry> &entries = OwnChunk(i, generation)->entries;
+  auto position = std::lower_bound(
+      entries.begin(), entries.end(), entry.name,
+      [](const Entry &e, std::string_view n) { return e.name < n; });
+  entries.insert(position, std::move(entry));
+  if (entries.size() > kChunkSize) {
+    auto upper = std::make_shared<Chunk>();
+    upper->generation = generation;
+    const auto middle = entries.begin() + entries.size() / 2;
+    upper->entries.assign(std::make_move_iterator(middle), std::make_move_iterator(entries.end()));
+    entries.erase(middle, entries.end());
+    chunks.insert(chunks.begin() + i + 1, std::move(upper));
+  }
+}
+
+void TreeIndex::Dir::Erase(std::string_view name, uint64_t generation) {
+  const size_t i = ChunkFor(name);
+  std::vector<Entry> &entries = OwnChunk(i, generation)->entries;
+  entries.erase(FindEntry(entries, name));
+  if (entries.size() >= kChunkSize / 4) {
+    return;
+  }
+  // Merge the chunk with a neighbour if the two fit in one.
+  auto fits = [this](size_t lower) {
+    return lower + 1 < chunks.size() &&
+           chunks[lower]->entries.size() + chunks[lower + 1]->entries.size() <= kChunkSize;
+  };
+  size_t lower;
+  if (fits(i)) {
+    lower = i;
+  } else if (i > 0 && fits(i - 1)) {
+    lower = i - 1;
+  } else {
+    if (entries.empty()) {
+      chunks.erase(chunks.begin() + i);
+    }
+    return;
+  }
+  std::vector<Entry> &merged = OwnChunk(lower, generation)->entries;
+  const std::vector<Entry> &upper = chunks[lower + 1]->entries;
+  merged.insert(merged.end(), upper.begin(), upper.end());
+  chunks.erase(chunks.begin() + lower + 1);
+}
+
+size_t TreeIndex::Dir::ChunkFor(std::string_view name) const {
+  // The first chunk whose last entry doesn't sort before name, or else the last one.
+  auto chunk = std::lower_bound(chunks.begin(), chunks.end() - 1, name,
+                                [](const std::shared_ptr<Chunk> &c, std::string_view n) {
+                                  return c->entries.back().name < n;
+                                });
+  return chunk - chunks.begin();
+}
+
+TreeIndex::Dir::Chunk *TreeIndex::Dir::OwnChunk(size_t i, uint64_t generation) {
+  if (chunks[i]->generation != generation) {
+    chunks[i] = std::make_shared<Chunk>(*chunks[i]);
+    chunks[i]->generation = generation;
+  }
+  return chunks[i].get();
+}
+
+TreeIndex::TreeIndex(const Path &root, const TreeIndexOptions &options, int fd)
+    : root_(root),
+      root_name_(PathBuilder(root).view()),
+      options_(options),
+      fd_(fd),
+      buffer_(kEventBufferSize) {}
+
+TreeIndex::~TreeIndex() {
+  close(fd_);
+  delete current_.load();
+  for (const Snapshot *snapshot : retired_) {
+    delete snapshot;
+  }
+  for (HazardSlot *slot = hazards_.load(); slot != nullptr;) {
+    HazardSlot *next = slot->next;
+    delete slot;
+    slot = next;
+  }
+}
+
+std::unique_ptr<TreeIndex> TreeIndex::Create(const Path &root, const TreeIndexOptions &options) {
+  const Path absolute = root.absolute();
+  struct stat st;
+  if (lstat(PathBuilder(absolute).c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+    return nullptr;
+  }
+  const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+  std::unique_ptr<TreeIndex> index(new TreeIndex(absolute, options, fd));
+  PathBuilder builder(index->root_);
+  index->working_ = index->ScanDir(&builder);
+  auto root_dir = index->dirs_.find("");
+  if (root_dir == index->dirs_.end() || root_dir->second.wd < 0) {
+    return nullptr;
+  }
+  index->root_wd_ = root_dir->second.wd;
+  index->Publish();
+  return index;
+}
+
+TreeIndex::SnapshotRef TreeIndex::snapshot() const {
+  HazardSlot *slot = AcquireSlot();
+  const Snapshot *snapshot = current_.load(std::memory_order_acquire);
+  for (;;) {
+    slot->snapshot.store(snapshot, std::memory_order_seq_cst);
+    // The updater may have replaced and retired the snapshot before it could see the slot, so it's
+    // only safe to use if it's still current now that the slot is visible.
+    const Snapshot *current = current_.load(std::memory_order_seq_cst);
+    if (current == snapshot) {
+      return SnapshotRef(slot, snapshot);
+    }
+    snapshot = current;
+  }
+}
+
+TreeIndex::HazardSlot *TreeIndex::AcquireSlot() const {
+  for (HazardSlot *slot = hazards_.load(std::memory_order_acquire); slot != nullptr;
+       slot = slot->next) {
+    if (!slot->in_use.load(std::memory_order_relaxed) &&
+        !slot->in_use.exchange(true, std::memory_order_acquire)) {
+      return slot;
+    }
+  }
+  auto *slot = new HazardSlot;
+  slot->in_use.store(true, std::memory_order_relaxed);
+  slot->next = hazards_.load(std::memory_order_relaxed);
+  // seq_cst, like the hazard stores, so that Reclaim() either sees the new slot or the reader sees
+  // the snapshot that replaced the one it's about to announce.
+  while (!hazards_.compare_exchange_weak(slot->next, slot, std::memory_order_seq_cst,
+                                         std::memory_order_relaxed)) {
+  }
+  return slot;
+}
+
+std::optional<size_t> TreeIndex::Poll(std::chrono::milliseconds timeout) {
+  if (root_lost_) {
+    return std::nullopt;
+  }
+  pollfd pfd = {fd_, POLLIN, 0};
+  int ready = poll(&pfd, 1, timeout.count());
+  if (ready < 0) {
+    return errno == EINTR ? std::optional<size_t>(0) : std::nullopt;
+  }
+  if (ready == 0) {
+    return 0;
+  }
+
+  std::unordered_set<std::string> dirty;
+  bool overflow = false;
+  size_t events = 0;
+  const auto deadline = std::chrono::steady_clock::now() + options_.coalesce_window;
+  for (;;) {
+    if (!ReadEvents(options_.max_batch_events, &dirty, &overflow, &events)) {
+      return std::nullopt;
+    }
+    const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    if (events >= options_.max_batch_events || remaining.count() <= 0 ||
+        poll(&pfd, 1, remaining.count()) <= 0) {
+      break;
+    }
+  }
+  stats_.events += events;
+  ++stats_.batches;
+
+  if (overflow) {
+    ++stats_.overflows;
+    CollectRescan(&dirty);
+  }
+  const size_t changes = Apply(dirty);
+  if (modified_) {
+    Publish();
+  }
+  return changes;
+}
+
+size_t TreeIndex::Rescan() {
+  std::unordered_set<std::string> dirty;
+  CollectRescan(&dirty);
+  const size_t changes = Apply(dirty);
+  if (modified_) {
+    Publish();
+  }
+  return changes;
+}
+
+std::shared_ptr<TreeIndex::Dir> TreeIndex::ScanDir(PathBuilder *builder) {
+  auto dir = std::make_shared<Dir>();
+  dir->generation = generation_;
+  // Watch before reading, so that entries created while reading produce events, and stat before
+  // reading, so that they leave the directory's mtime newer than the recorded one.
+  DirState *state = AddWatch(RelativeName(builder->view()), builder->c_str());
+  struct stat st;
+  if (lstat(builder->c_str(), &st) != 0) {
+    return dir;
+  }
+  state->ino = st.st_ino;
+  state->mtime = st.st_mtim;
+  state->racy = IsRacy(st.st_mtim);
+
+  std::vector<Listed> listing;
+  ListDir(builder->c_str(), &listing);
+  dir->chunks.reserve((listing.size() + kChunkSize - 1) / kChunkSize);
+  for (Listed &listed : listing) {
+    Dir::Entry entry{std::move(listed.name), listed.is_dir, nullptr};
+    if (entry.is_dir) {
+      builder->push(entry.name);
+      entry.dir = ScanDir(builder);
+      builder->pop();
+      dir->size += entry.dir->size;
+    }
+    ++dir->size;
+    dir->Append(std::move(entry), generation_);
+  }
+  return dir;
+}
+
+TreeIndex::DirState *TreeIndex::AddWatch(const std::string &rel, const char *path) {
+  DirState *state = &dirs_[rel];
+  *state = DirState();
+  state->wd = inotify_add_watch(fd_, path, kWatchMask);
+  if (state->wd < 0) {
+    ++stats_.failed_watches;
+    return state;
+  }
+  auto [it, inserted] = wd_dirs_.emplace(state->wd, rel);
+  if (!inserted && it->second != rel) {
+    // The same directory under another name, which its events are now reported under.
+    auto other = dirs_.find(it->second);
+    if (other != dirs_.end()) {
+      other->second.wd = -1;
+    }
+    it->second = rel;
+  }
+  return state;
+}
+
+void TreeIndex::DropWatches(const std::string &rel) {
+  // Descendants are the names starting with rel + '/', all of which sort before rel + ('/' + 1).
+  const std::string prefix = rel + '/';
+  const std::string end = rel + static_cast<char>('/' + 1);
+  for (auto it = dirs_.lower_bound(rel); it != dirs_.end() && it->first < end;) {
+    if (it->first != rel && it->first.compare(0, prefix.size(), prefix) != 0) {
+      ++it;
+      continue;
+    }
+    auto wd = wd_dirs_.find(it->second.wd);
+    if (wd != wd_dirs_.end() && wd->second == it->first) {
+      inotify_rm_watch(fd_, it->second.wd);
+      wd_dirs_.erase(wd);
+    }
+    it = dirs_.erase(it);
+  }
+}
+
+bool TreeIndex::ReadEvents(size_t max_events, std::unordered_set<std::string> *dirty,
+                           bool *overflow, size_t *events) {
+  while (*events < max_events) {
+    // Read little more than the remaining budget, so that a storm can't keep the batch growing. A
+    // read has to have room for at least one event with the longest possible name.
+    const size_t budget = (max_events - *events) * sizeof(inotify_event) + NAME_MAX + 1;
+    const ssize_t n = read(fd_, buffer_.data(), std::min(budget, buffer_.size()));
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno == EAGAIN;
+    }
+    for (const char *p = buffer_.data(); p < buffer_.data() + n;) {
+      const auto *event = reinterpret_cast<const inotify_event *>(p);
+      p += sizeof(inotify_event) + event->len;
+      ++*events;
+      if (event->mask & IN_Q_OVERFLOW) {
+        *overflow = true;
+        continue;
+      }
+      auto dir = wd_dirs_.find(event->wd);
+      if (dir == wd_dirs_.end()) {
+        continue;
+      }
+      if (event->mask & IN_IGNORED) {
+        // The directory is gone (its parent's event removes it from the tree) or its filesystem
+        // was unmounted.
+        if (event->wd == root_wd_) {
+          root_lost_ = true;
+        }
+        auto state = dirs_.find(dir->second);
+        if (state != dirs_.end()) {
+          state->second.wd = -1;
+        }
+        wd_dirs_.erase(dir);
+        continue;
+      }
+      if (event->len == 0) {
+        continue;
+      }
+      // The name is NUL-padded to event->len.
+      const std::string_view name(event->name);
+      dirty->insert(dir->second.empty() ? std::string(name)
+                                        : dir->second + '/' + std::string(name));
+    }
+  }
+  return true;
+}
+
+void TreeIndex::CollectRescan(std::unordered_set<std::string> *dirty) {
+  for (auto &[rel, state] : dirs_) {
+    const Dir *dir = FindDir(rel);
+    if (dir == nullptr) {
+      continue;
+    }
+    const std::string path = AbsoluteName(rel);
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) || st.st_ino != state.ino) {
+      // Revalidating it from its parent replaces the whole subtree.
+      if (!rel.empty()) {
+        dirty->insert(rel);
+      }
+      continue;
+    }
+    if (!state.racy && SameTime(st.st_mtim, state.mtime)) {
+      continue;
+    }
+    std::vector<Listed> listing;
+    if (!ListDir(path.c_str(), &listing)) {
+      continue;
+    }
+    ++stats_.rescanned_dirs;
+    // Both are sorted by name, so merge them to find the entries that differ.
+    const std::string prefix = rel.empty() ? rel : rel + '/';
+    std::vector<const Dir::Entry *> entries;
+    dir->ForEach([&entries](const Dir::Entry &entry) { entries.push_back(&entry); });
+    auto entry = entries.begin();
+    auto listed = listing.begin();
+    while (entry != entries.end() || listed != listing.end()) {
+      if (listed == listing.end() || (entry != entries.end() && (*entry)->name < listed->name)) {
+        dirty->insert(prefix + (*entry)->name);
+        ++entry;
+      } else if (entry == entries.end() || listed->name < (*entry)->name) {
+        dirty->insert(prefix + listed->name);
+        ++listed;
+      } else {
+        if ((*entry)->is_dir != listed->is_dir) {
+          dirty->insert(prefix + (*entry)->name);
+        }
+        ++entry;
+        ++listed;
+      }
+    }
+    // Whatever differs is about to be applied, so the directory is up to date as of this mtime.
+    state.mtime = st.st_mtim;
+    state.racy = IsRacy(st.st_mtim);
+  }
+}
+
+size_t TreeIndex::Apply(const std::unordered_set<std::string> &dirty) {
+  struct Check {
+    std::string rel;
+    bool exists;
+    bool is_dir;
+    ino_t ino;
+  };
+  std::vector<Check> checks;
+  checks.reserve(dirty.size());
+  for (const std::string &rel : dirty) {
+    struct stat st;
+    const bool exists = lstat(AbsoluteName(rel).c_str(), &st) == 0;
+    checks.push_back({rel, exists, exists && S_ISDIR(st.st_mode), exists ? st.st_ino : 0});
+  }
+  stats_.revalidated += checks.size();
+  // Parents first, so that a new directory is scanned before the entries below it are checked.
+  std::sort(checks.begin(), checks.end(), [](const Check &a, const Check &b) {
+    const size_t depth_a = Depth(a.rel), depth_b = Depth(b.rel);
+    return depth_a != depth_b ? depth_a < depth_b : a.rel < b.rel;
+  });
+
+  size_t changes = 0;
+  // All removals go first: a directory renamed within the tree has to give up its watches under
+  // the old name before it's scanned and watched under the new one.
+  for (const Check &check : checks) {
+    const Dir *parent = FindDir(ParentName(check.rel));
+    if (parent == nullptr) {
+      continue;
+    }
+    const Dir::Entry *entry = parent->Find(BaseName(check.rel));
+    if (entry == nullptr) {
+      continue;
+    }
+    auto state = entry->is_dir ? dirs_.find(check.rel) : dirs_.end();
+    if (!check.exists || check.is_dir != entry->is_dir ||
+        (state != dirs_.end() && check.ino != state->second.ino)) {
+      changes += Remove(check.rel);
+    }
+  }
+  for (const Check &check : checks) {
+    if (check.exists) {
+      changes += Insert(check.rel, check.is_dir);
+    }
+  }
+  return changes;
+}
+
+size_t TreeIndex::Remove(const std::string &rel) {
+  std::vector<Dir *> chain;
+  Dir *parent = MutableDir(ParentName(rel), &chain);
+  const Dir::Entry *entry = parent->Find(BaseName(rel));
+  const uint64_t removed = 1 + (entry->dir != nullptr ? entry->dir->size : 0);
+  const bool was_dir = entry->is_dir;
+  parent->Erase(BaseName(rel), generation_);
+  for (Dir *dir : chain) {
+    dir->size -= removed;
+  }
+  if (was_dir) {
+    DropWatches(rel);
+  }
+  return removed;
+}
+
+size_t TreeIndex::Insert(const std::string &rel, bool is_dir) {
+  const std::string_view name = BaseName(rel);
+  // Check before MutableDir(), which would copy the directory even if it's unchanged.
+  const Dir *existing = FindDir(ParentName(rel));
+  if (existing == nullptr || existing->Find(name) != nullptr) {
+    return 0;
+  }
+  std::vector<Dir *> chain;
+  Dir *parent = MutableDir(ParentName(rel), &chain);
+  Dir::Entry entry{std::string(name), is_dir, nullptr};
+  uint64_t added = 1;
+  if (is_dir) {
+    PathBuilder builder(root_);
+    ForEachComponent(rel, [&builder](std::string_view component) {
+      return builder.push(component);
+    });
+    entry.dir = ScanDir(&builder);
+    added += entry.dir->size;
+  }
+  parent->Insert(std::move(entry), generation_);
+  for (Dir *dir : chain) {
+    dir->size += added;
+  }
+  return added;
+}
+
+void TreeIndex::Publish() {
+  const Snapshot *replaced =
+      current_.exchange(new Snapshot(root_, working_), std::memory_order_seq_cst);
+  // Everything reachable from the snapshot is now shared with readers.
+  ++generation_;
+  modified_ = false;
+  if (replaced != nullptr) {
+    retired_.push_back(replaced);
+  }
+  Reclaim();
+}
+
+void TreeIndex::Reclaim() {
+  // A reader that loaded a retired snapshot either announced it before this scan, or will find
+  // it's no longer current and not use it.
+  std::vector<const Snapshot *> in_use;
+  for (HazardSlot *slot = hazards_.load(std::memory_order_seq_cst); slot != nullptr;
+       slot = slot->next) {
+    if (const Snapshot *snapshot = slot->snapshot.load(std::memory_order_seq_cst)) {
+      in_use.push_back(snapshot);
+    }
+  }
+  std::sort(in_use.begin(), in_use.end());
+  auto kept = std::remove_if(retired_.begin(), retired_.end(), [&in_use](const Snapshot *s) {
+    if (std::binary_search(in_use.begin(), in_use.end(), s)) {
+      return false;
+    }
+    delete s;
+    return true;
+  });
+  retired_.erase(kept, retired_.end());
+}
+
+const TreeIndex::Dir *TreeIndex::FindDir(std::string_view rel) const {
+  const Dir *dir = working_.get();
+  const bool found = ForEachComponent(rel, [&dir](std::string_view component) {
+    const Dir::Entry *entry = dir->Find(component);
+    if (entry == nullptr || entry->dir == nullptr) {
+      return false;
+    }
+    dir = entry->dir.get();
+    return true;
+  });
+  return found ? dir : nullptr;
+}
+
+TreeIndex::Dir *TreeIndex::MutableDir(std::string_view rel, std::vector<Dir *> *chain) {
+  Dir *dir = Own(&working_);
+  chain->push_back(dir);
+  const bool found = ForEachComponent(rel, [this, &dir, chain](std::string_view component) {
+    const Dir::Entry *existing = dir->Find(component);
+    if (existing == nullptr || existing->dir == nullptr) {
+      return false;
+    }
+    Dir::Entry *entry = dir->MutableFind(component, generation_);
+    dir = Own(&entry->dir);
+    chain->push_back(dir);
+    return true;
+  });
+  return found ? dir : nullptr;
+}
+
+TreeIndex::Dir *TreeIndex::Own(std::shared_ptr<Dir> *slot) {
+  if ((*slot)->generation != generation_) {
+    *slot = std::make_shared<Dir>(**slot);
+    (*slot)->generation = generation_;
+  }
+  modified_ = true;
+  return slot->get();
+}
+
+std::string TreeIndex::RelativeName(std::string_view path) const {
+  if (path.size() <= root_name_.size()) {
+    return std::string();
+  }
+  // Skip the separator following the root, unless the root is "/" itself.
+  return std::string(path.substr(root_name_.size() + (root_name_.size() > 1 ? 1 : 0)));
+}
+
+std::string TreeIndex::AbsoluteName(std::string_view rel) const {
+  std::string path = root_name_;
+  if (!rel.empty()) {
+    if (path.size() > 1) {
+      path += '/';
+    }
+    path += rel;
+  }
+  return path;
+}
+
+TreeIndex::Snapshot::Snapshot(const Path &root, std::shared_ptr<const Dir> tree)
+    : root_(root), tree_(std::move(tree)) {}
+
+bool TreeIndex::Snapshot::contains(const Path &path) const {
+  const Dir *dir;
+  return Lookup(path, &dir);
+}
+
+bool TreeIndex::Snapshot::is_dir(const Path &path) const {
+  const Dir *dir;
+  return Lookup(path, &dir) && dir != nullptr;
+}
+
+std::optional<std::vector<std::string>> TreeIndex::Snapshot::children(const Path &dir) const {
+  const Dir *node;
+  if (!Lookup(dir, &node) || node == nullptr) {
+    return std::nullopt;
+  }
+  std::vector<std::string> names;
+  node->ForEach([&names](const Dir::Entry &entry) { names.push_back(entry.name); });
+  return names;
+}
+
+uint64_t TreeIndex::Snapshot::size() const { return tree_->size; }
+
+bool TreeIndex::Snapshot::Lookup(const Path &path, const Dir **dir) const {
+  int64_t first = 0;
+  if (path.is_absolute()) {
+    if (path.num_components() < root_.num_components()) {
+      return false;
+    }
+    for (; first < root_.num_components(); ++first) {
+      if (path.component(first) != root_.component(first)) {
+        return false;
+      }
+    }
+  }
+  const Dir *node = tree_.get();
+  for (int64_t i = first; i < path.num_components(); ++i) {
+    // Only directories have entries.
+    if (node == nullptr) {
+      return false;
+    }
+    const Dir::Entry *entry = node->Find(path.component(i));
+    if (entry == nullptr) {
+      return false;
+    }
+    node = entry->dir.get();
+  }
+  *dir = node;
+  return true;
+}
+
+TreeIndex::SnapshotRef::SnapshotRef(SnapshotRef &&other) noexcept
+    : slot_(other.slot_), snapshot_(other.snapshot_) {
+  other.slot_ = nullptr;
+}
+
+TreeIndex::SnapshotRef &TreeIndex::SnapshotRef::operator=(SnapshotRef &&other) noexcept {
+  if (this != &other) {
+    Release();
+    slot_ = other.slot_;
+    snapshot_ = other.snapshot_;
+    other.slot_ = nullptr;
+  }
+  return *this;
+}
+
+TreeIndex::SnapshotRef::~SnapshotRef() { Release(); }
+
+void TreeIndex::SnapshotRef::Release() {
+  if (slot_ != nullptr) {
+    slot_->snapshot.store(nullptr, std::memory_order_release);
+    slot_->in_use.store(false, std::memory_order_release);
+    slot_ = nullptr;
+  }
+}
+
+}  // namespace spin_2_fs
+// vim: sw=2:sts=2:tw=100:et:cindent:cinoptions=l1,g1,h1,N-s,E-s,i2s,+2s,(0,w1,W2s
@@ -0,0 +1,260 @@
+// Copyright 2017 David Finkel
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef include_spin_2_fs_tree_index_h
+#define include_spin_2_fs_tree_index_h
+
+#include <sys/types.h>
+#include <time.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "path.h"
+#include "path_builder.h"
+
+namespace spin_2_fs {
+
+struct TreeIndexOptions {
+  // Once the first event of a batch arrives, Poll() keeps reading events for this long, so that a
+  // storm of changes is revalidated and published once rather than event by event.
+  std::chrono::milliseconds coalesce_window{5};
+  // A batch is closed early once it holds this many events (give or take the few that fit in the
+  // last read).
+  size_t max_batch_events = 65536;
+};
+
+struct TreeIndexStats {
+  // inotify events read.
+  uint64_t events = 0;
+  // Batches applied by Poll().
+  uint64_t batches = 0;
+  // Distinct paths lstat()ed after coalescing events.
+  uint64_t revalidated = 0;
+  // Times the kernel's event queue overflowed.
+  uint64_t overflows = 0;
+  // Directories re-read by a rescan because their mtime or inode changed.
+  uint64_t rescanned_dirs = 0;
+  // Directories indexed without a watch (e.g. after hitting max_user_watches), which only a
+  // rescan keeps up to date.
+  uint64_t failed_watches = 0;
+};
+
+// TreeIndex keeps an in-memory index of the names and types of everything below a directory,
+// kept current with inotify.
+//
+// The tree is walked once on creation, adding a watch to every directory. After that, Poll() reads
+// events in batches, coalesces them into the set of affected paths and revalidates each with
+// lstat(), so the work done is proportional to the number of changes (give or take the copying of
+// the directories they're in, described below) rather than to the size of the tree. Directories
+// that appear are scanned (and watched) individually. If the kernel's event queue overflows, only
+// directories whose mtime or inode differ from when they were last read are re-read.
+//
+// Queries go through immutable snapshots. Each batch copies just the directory nodes it changes
+// (and their ancestors) and publishes a new snapshot that shares everything else with the
+// previous one. A directory's entries are held in chunks of at most 128, which copies of it share
+// in turn, so copying a directory for a change costs a pointer per chunk plus the chunk that
+// changes: creating a file in a directory of a million entries copies some 8,000 pointers rather
+// than a million names.
+//
+// Snapshots are published through an atomic pointer and protected by hazard pointers: a reader
+// announces the snapshot it's using in a slot of its own, and the updater frees a replaced snapshot
+// only once no slot refers to it. Taking a reference and querying through it therefore take no
+// locks and never wait for the updater, and a snapshot never changes while referenced.
+//
+// Poll() and Rescan() must be called from a single thread; snapshot() may be called from any.
+// Symlinks are indexed but not followed, and the root itself must not be moved or deleted.
+class TreeIndex {
+ public:
+  class Snapshot;
+  class SnapshotRef;
+
+  // Indexes the directory root. Returns nullptr if root isn't a directory or can't be watched.
+  // The index is returned by pointer so that its address stays stable for the threads using it.
+  static std::unique_ptr<TreeIndex> Create(const Path &root, const TreeIndexOptions &options = {});
+  ~TreeIndex();
+
+  TreeIndex(const TreeIndex &) = delete;
+  TreeIndex &operator=(const TreeIndex &) = delete;
+
+  const Path &root() const { return root_; }
+  // Returns a reference to the most recently published snapshot.
+  SnapshotRef snapshot() const;
+
+  // Waits up to timeout for events, then reads and applies one batch of them, publishing a new
+  // snapshot if anything changed. Returns the number of entries added or removed (a directory
+  // counting along with everything below it), or std::nullopt if the inotify descriptor failed or
+  // the root's watch was lost.
+  std::optional<size_t> Poll(std::chrono::milliseconds timeout);
+  // Re-reads every directory whose mtime or inode changed since it was last read, as done after
+  // a queue overflow, and publishes the result. Useful to pick up changes in directories that
+  // couldn't be watched. Returns the number of entries added or removed.
+  size_t Rescan();
+
+  // The inotify descriptor, for waiting on in an event loop before calling Poll().
+  int fd() const { return fd_; }
+  const TreeIndexStats &stats() const { return stats_; }
+
+ private:
+  struct Dir;
+  struct HazardSlot;
+
+  // What the updater knows about an indexed directory. It's kept out of the tree so that updating
+  // it doesn't require publishing a snapshot.
+  struct DirState {
+    // Watch descriptor, or -1 if the directory couldn't be watched.
+    int wd = -1;
+    // Identity and mtime of the directory when its entries were last read.
+    ino_t ino = 0;
+    timespec mtime = {};
+    bool racy = true;
+  };
+
+  TreeIndex(const Path &root, const TreeIndexOptions &options, int fd);
+
+  // Watches and reads the directory at builder's current path and everything below it.
+  std::shared_ptr<Dir> ScanDir(PathBuilder *builder);
+  // Watches the directory at path, returning its (otherwise unset) state.
+  DirState *AddWatch(const std::string &rel, const char *path);
+  // Removes the watches of rel and every directory below it.
+  void DropWatches(const std::string &rel);
+
+  // Reads pending events until there are none left or *events reaches about max_events, adding
+  // the paths they name to *dirty. Returns false on error.
+  bool ReadEvents(size_t max_events, std::unordered_set<std::string> *dirty, bool *overflow,
+                  size_t *events);
+  // Adds to *dirty every entry that differs between the tree and the directories that changed
+  // since they were read.
+  void CollectRescan(std::unordered_set<std::string> *dirty);
+  // Revalidates the given paths against the filesystem. Returns the number of entries added or
+  // removed.
+  size_t Apply(const std::unordered_set<std::string> &dirty);
+  size_t Remove(const std::string &rel);
+  size_t Insert(const std::string &rel, bool is_dir);
+  void Publish();
+  // Frees the retired snapshots that no reader refers to.
+  void Reclaim();
+  // Returns an unused hazard slot, marked as in use.
+  HazardSlot *AcquireSlot() const;
+
+  // Returns the directory at rel in the working tree, or nullptr.
+  const Dir *FindDir(std::string_view rel) const;
+  // As FindDir(), but first copies the directory and its ancestors unless they were already copied
+  // since the last Publish(), and appends them (root first) to *chain.
+  Dir *MutableDir(std::string_view rel, std::vector<Dir *> *chain);
+  Dir *Own(std::shared_ptr<Dir> *slot);
+
+  // Converts between paths relative to the root ("" for the root itself) and absolute ones.
+  std::string RelativeName(std::string_view path) const;
+  std::string AbsoluteName(std::string_view rel) const;
+
+  const Path root_;
+  const std::string root_name_;
+  const TreeIndexOptions options_;
+  const int fd_;
+  int root_wd_ = -1;
+  bool root_lost_ = false;
+
+  // The tree being updated. Nodes whose generation is generation_ haven't been published yet and
+  // may be changed in place.
+  std::shared_ptr<Dir> working_;
+  uint64_t generation_ = 1;
+  bool modified_ = false;
+  // The published snapshot, and the replaced ones that readers may still refer to.
+  std::atomic<const Snapshot *> current_{nullptr};
+  std::vector<const Snapshot *> retired_;
+  // A list of hazard slots, which only grows, and only while more references are held at once
+  // than ever before.
+  mutable std::atomic<HazardSlot *> hazards_{nullptr};
+
+  // Every indexed directory, keyed by path relative to the root. Ordered so that a directory's
+  // descendants form a contiguous range.
+  std::map<std::string, DirState> dirs_;
+  std::unordered_map<int, std::string> wd_dirs_;
+  std::vector<char> buffer_;
+  TreeIndexStats stats_;
+};
+
+// An immutable view of the indexed tree. Paths may be given either as absolute paths under the
+// root or relative to it.
+class TreeIndex::Snapshot {
+ public:
+  const Path &root() const { return root_; }
+
+  bool contains(const Path &path) const;
+  bool is_dir(const Path &path) const;
+  // Returns the sorted names of dir's entries, or std::nullopt if it isn't an indexed directory.
+  std::optional<std::vector<std::string>> children(const Path &dir) const;
+  // Number of entries below the root.
+  uint64_t size() const;
+
+ private:
+  friend class TreeIndex;
+  Snapshot(const Path &root, std::shared_ptr<const Dir> tree);
+
+  // Sets *dir to the node of path if it's a directory, or to nullptr if it's something else.
+  // Returns false if path isn't in the tree.
+  bool Lookup(const Path &path, const Dir **dir) const;
+
+  const Path root_;
+  const std::shared_ptr<const Dir> tree_;
+};
+
+// A reference to a published snapshot, which stays valid for as long as the reference exists. It
+// must be destroyed before the TreeIndex that returned it.
+class TreeIndex::SnapshotRef {
+ public:
+  SnapshotRef(SnapshotRef &&other) noexcept;
+  SnapshotRef &operator=(SnapshotRef &&other) noexcept;
+  ~SnapshotRef();
+
+  const Snapshot &operator*() const { return *snapshot_; }
+  const Snapshot *operator->() const { return snapshot_; }
+
+ private:
+  friend class TreeIndex;
+  SnapshotRef(HazardSlot *slot, const Snapshot *snapshot) : slot_(slot), snapshot_(snapshot) {}
+  void Release();
+
+  HazardSlot *slot_;
+  const Snapshot *snapshot_;
+};
+
+}  // namespace spin_2_fs
+
+#endif  // include_spin_2_fs_tree_index_h
+// vim: sw=2:sts=2:tw=100:et:cindent:cinoptions=l1,g1,h1,N-s,E-s,i2s,+2s,(0,w1,W2s
@@ -0,0 +1,96 @@
+// Copyright 2017 David Finkel
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "benchmark/benchmark.h"
+#include "tree_index.h"
+
+namespace spin_2_fs {
+namespace {
+
+void MakeFile(const std::string &path) { close(open(path.c_str(), O_WRONLY | O_CREAT, 0644)); }
+
+void RemoveTree(const std::string &dir) {
+  nftw(dir.c_str(),
+       [](const char *path, const struct stat *, int, struct FTW *) { return remove(path); }, 16,
+       FTW_DEPTH | FTW_PHYS);
+}
+
+// Creates and removes one file in a flat directory of state.range(0) files, timing the Poll() that
+// applies each change. The cost of a change should depend on the change rather than on the size of
+// the directory it's in.
+void BM_PollFlatDir(benchmark::State &state) {
+  char name[] = "/tmp/tree_index_benchmark.XXXXXX";
+  if (mkdtemp(name) == nullptr) {
+    state.SkipWithError("mkdtemp failed");
+    return;
+  }
+  const std::string dir = name;
+  for (int64_t i = 0; i < state.range(0); i++) {
+    MakeFile(dir + "/file" + std::to_string(i));
+  }
+  TreeIndexOptions options;
+  options.coalesce_window = std::chrono::milliseconds(0);
+  auto index = TreeIndex::Create(Path(dir), options);
+  if (index == nullptr) {
+    RemoveTree(dir);
+    state.SkipWithError("TreeIndex::Create failed");
+    return;
+  }
+  const std::string path = dir + "/new";
+  for (auto _ : state) {
+    // The filesystem's own cost grows with the directory, and isn't what's being measured.
+    state.PauseTiming();
+    MakeFile(path);
+    state.ResumeTiming();
+    index->Poll(std::chrono::milliseconds(1000));
+    state.PauseTiming();
+    unlink(path.c_str());
+    state.ResumeTiming();
+    index->Poll(std::chrono::milliseconds(1000));
+  }
+  state.SetItemsProcessed(state.iterations() * 2);
+  index.reset();
+  RemoveTree(dir);
+}
+BENCHMARK(BM_PollFlatDir)->Arg(1000)->Arg(10000)->Arg(200000)->Unit(benchmark::kMicrosecond);
+
+}  // anonymous namespace
+}  // namespace spin_2_fs
+
+BENCHMARK_MAIN();
+// vim: sw=2:sts=2:tw=100:et:cindent:cinoptions=l1,g1,h1,N-s,E-s,i2s,+2s,(0,w1,W2s
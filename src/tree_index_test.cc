@@ -0,0 +1,420 @@
+// Copyright 2017 David Finkel
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <functional>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tree_index.h"
+
+namespace spin_2_fs {
+namespace {
+
+using testing::ElementsAre;
+
+class TestTreeIndex : public testing::Test {
+ protected:
+  void SetUp() override {
+    char name[] = "/tmp/tree_index_test.XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(name));
+    dir_ = name;
+  }
+  void TearDown() override {
+    nftw(dir_.c_str(),
+         [](const char *path, const struct stat *, int, struct FTW *) { return remove(path); }, 16,
+         FTW_DEPTH | FTW_PHYS);
+  }
+
+  std::string Name(const std::string &rel) const { return dir_ + "/" + rel; }
+  void MakeDir(const std::string &rel) { ASSERT_EQ(0, mkdir(Name(rel).c_str(), 0755)); }
+  void MakeFile(const std::string &rel) {
+    const int fd = open(Name(rel).c_str(), O_WRONLY | O_CREAT, 0644);
+    ASSERT_GE(fd, 0);
+    close(fd);
+  }
+
+  // Polls until done returns true for the latest snapshot, or a few seconds have passed.
+  bool PollUntil(TreeIndex *index, const std::function<bool(const TreeIndex::Snapshot &)> &done) {
+    for (int i = 0; i < 100; ++i) {
+      if (done(*index->snapshot())) {
+        return true;
+      }
+      if (!index->Poll(std::chrono::milliseconds(50))) {
+        return false;
+      }
+    }
+    return done(*index->snapshot());
+  }
+
+  std::string dir_;
+};
+
+TEST_F(TestTreeIndex, InitialScan) {
+  MakeDir("a");
+  MakeDir("a/b");
+  MakeFile("a/b/f");
+  MakeFile("g");
+  ASSERT_EQ(0, symlink("a", Name("link").c_str()));
+
+  auto index = TreeIndex::Create(Path(dir_));
+  ASSERT_NE(nullptr, index);
+  auto snapshot = index->snapshot();
+  EXPECT_EQ(5u, snapshot->size());
+  EXPECT_TRUE(snapshot->is_dir(Path(dir_)));
+  EXPECT_TRUE(snapshot->is_dir(Path(Name("a/b"))));
+  EXPECT_TRUE(snapshot->contains(Path(Name("a/b/f"))));
+  EXPECT_FALSE(snapshot->is_dir(Path(Name("a/b/f"))));
+  // Symlinks are indexed, but not followed.
+  EXPECT_TRUE(snapshot->contains(Path(Name("link"))));
+  EXPECT_FALSE(snapshot->is_dir(Path(Name("link"))));
+  EXPECT_FALSE(snapshot->contains(Path(Name("link/b"))));
+  // Relative paths are relative to the root.
+  EXPECT_TRUE(snapshot->contains(Path("a/b/f")));
+  EXPECT_FALSE(snapshot->contains(Path("a/b/f/x")));
+  EXPECT_FALSE(snapshot->contains(Path("/elsewhere")));
+
+  EXPECT_THAT(*snapshot->children(Path(dir_)), ElementsAre("a", "g", "link"));
+  EXPECT_THAT(*snapshot->children(Path("a")), ElementsAre("b"));
+  EXPECT_FALSE(snapshot->children(Path("g")).has_value());
+}
+
+TEST_F(TestTreeIndex, NotADirectory) {
+  MakeFile("f");
+  EXPECT_EQ(nullptr, TreeIndex::Create(Path(Name("f"))));
+  EXPECT_EQ(nullptr, TreeIndex::Create(Path(Name("missing"))));
+}
+
+TEST_F(TestTreeIndex, CreateAndDelete) {
+  MakeDir("a");
+  auto index = TreeIndex::Create(Path(dir_));
+  ASSERT_NE(nullptr, index);
+  const auto before = index->snapshot();
+
+  MakeFile("a/f");
+  MakeFile("g");
+  EXPECT_TRUE(PollUntil(index.get(), [](const TreeIndex::Snapshot &s) {
+    return s.contains(Path("a/f")) && s.contains(Path("g"));
+  }));
+  EXPECT_EQ(3u, index->snapshot()->size());
+  // Snapshots already handed out don't change.
+  EXPECT_EQ(1u, before->size());
+  EXPECT_FALSE(before->contains(Path("a/f")));
+
+  ASSERT_EQ(0, unlink(Name("a/f").c_str()));
+  EXPECT_TRUE(PollUntil(index.get(), [](const TreeIndex::Snapshot &s) {
+    return !s.contains(Path("a/f"));
+  }));
+  EXPECT_EQ(2u, index->snapshot()->size());
+}
+
+TEST_F(TestTreeIndex, NewSubtree) {
+  auto index = TreeIndex::Create(Path(dir_));
+  ASSERT_NE(nullptr, index);
+
+  // Everything below a is created before its watch can be added, so it's found by scanning a.
+  MakeDir("a");
+  MakeDir("a/b");
+  MakeDir("a/b/c");
+  MakeFile("a/b/c/f");
+  EXPECT_TRUE(PollUntil(index.get(), [](const TreeIndex::Snapshot &s) {
+    return s.contains(Path("a/b/c/f"));
+  }));
+  EXPECT_EQ(4u, index->snapshot()->size());
+
+  // And then watched.
+  MakeFile("a/b/c/g");
+  EXPECT_TRUE(PollUntil(index.get(), [](const TreeIndex::Snapshot &s) {
+    return s.contains(Path("a/b/c/g"));
+  }));
+}
+
+TEST_F(TestTreeIndex, LargeDirectory) {
+  // Enough entries to span several chunks, which the changes below split, merge and empty.
+  std::set<std::string> names;
+  auto file = [](int i, const char *suffix = "") {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "f%04d%s", i, suffix);
+    return std::string(buf);
+  };
+  auto add = [this, &names](const std::string &name) {
+    MakeFile("big/" + name);
+    names.insert(name);
+  };
+  auto remove = [this, &names](const std::string &name) {
+    ASSERT_EQ(0, unlink(Name("big/" + name).c_str()));
+    names.erase(name);
+  };
+  // Polls until the index has as many entries as names, plus "big" and the file below
+  // "big/f0700sub".
+  auto poll = [this, &names](TreeIndex *index) {
+    const uint64_t size = names.size() + 2;
+    EXPECT_TRUE(
+        PollUntil(index, [size](const TreeIndex::Snapshot &s) { return s.size() == size; }));
+  };
+
+  MakeDir("big");
+  MakeDir("big/f0700sub");
+  names.insert("f0700sub");
+  for (int i = 0; i < 1000; ++i) {
+    add(file(i));
+  }
+  auto index = TreeIndex::Create(Path(dir_));
+  ASSERT_NE(nullptr, index);
+  const auto before = index->snapshot();
+  const std::vector<std::string> original(names.begin(), names.end());
+
+  for (int i = 0; i < 400; ++i) {
+    remove(file(i));
+  }
+  for (int i = 500; i < 800; ++i) {
+    add(file(i, "a"));
+  }
+  MakeFile("big/f0700sub/g");
+  poll(index.get());
+  const auto after = index->snapshot();
+  const std::vector<std::string> changed(names.begin(), names.end());
+  EXPECT_EQ(changed, after->children(Path("big")));
+  EXPECT_TRUE(after->contains(Path("big/f0700sub/g")));
+  EXPECT_TRUE(after->contains(Path("big/f0799a")));
+  EXPECT_FALSE(after->contains(Path("big/f0399")));
+
+  // Thin out the chunks that were just split, and empty the last one.
+  for (int i = 500; i < 700; ++i) {
+    remove(file(i));
+  }
+  for (int i = 900; i < 1000; ++i) {
+    remove(file(i));
+  }
+  poll(index.get());
+  EXPECT_EQ(std::vector<std::string>(names.begin(), names.end()),
+            index->snapshot()->children(Path("big")));
+
+  // Snapshots taken earlier still have the entries they had.
+  EXPECT_EQ(changed, after->children(Path("big")));
+  EXPECT_EQ(original, before->children(Path("big")));
+  EXPECT_FALSE(before->contains(Path("big/f0700sub/g")));
+}
+
+TEST_F(TestTreeIndex, RenameDirectory) {
+  MakeDir("a");
+  MakeDir("a/b");
+  MakeFile("a/b/f");
+  MakeDir("c");
+  auto index = TreeIndex::Create(Path(dir_));
+  ASSERT_NE(nullptr, index);
+
+  ASSERT_EQ(0, rename(Name("a/b").c_str(), Name("c/d").c_str()));
+  EXPECT_TRUE(PollUntil(index.get(), [](const TreeIndex::Snapshot &s) {
+    return s.contains(Path("c/d/f")) && !s.contains(Path("a/b"));
+  }));
+  EXPECT_EQ(4u, index->snapshot()->size());
+
+  // Events from the moved directory are reported under its new name.
+  MakeFile("c/d/g");
+  EXPECT_TRUE(PollUntil(index.get(), [](const TreeIndex::Snapshot &s) {
+    return s.contains(Path("c/d/g"));
+  }));
+  EXPECT_FALSE(index->snapshot()->contains(Path("a/b/g")));
+}
+
+TEST_F(TestTreeIndex, ReplaceFileWithDirectory) {
+  MakeFile("x");
+  auto index = TreeIndex::Create(Path(dir_));
+  ASSERT_NE(nullptr, index);
+
+  ASSERT_EQ(0, unlink(Name("x").c_str()));
+  MakeDir("x");
+  MakeFile("x/f");
+  EXPECT_TRUE(PollUntil(index.get(), [](const TreeIndex::Snapshot &s) {
+    return s.is_dir(Path("x")) && s.contains(Path("x/f"));
+  }));
+  EXPECT_EQ(2u, index->snapshot()->size());
+}
+
+TEST_F(TestTreeIndex, RemoveSubtree) {
+  MakeDir("a");
+  MakeDir("a/b");
+  MakeFile("a/b/f");
+  MakeFile("g");
+  auto index = TreeIndex::Create(Path(dir_));
+  ASSERT_NE(nullptr, index);
+
+  ASSERT_EQ(0, unlink(Name("a/b/f").c_str()));
+  ASSERT_EQ(0, rmdir(Name("a/b").c_str()));
+  ASSERT_EQ(0, rmdir(Name("a").c_str()));
+  EXPECT_TRUE(PollUntil(index.get(), [](const TreeIndex::Snapshot &s) {
+    return !s.contains(Path("a"));
+  }));
+  EXPECT_EQ(1u, index->snapshot()->size());
+
+  // The directory's name can be reused.
+  MakeDir("a");
+  MakeFile("a/h");
+  EXPECT_TRUE(PollUntil(index.get(), [](const TreeIndex::Snapshot &s) {
+    return s.contains(Path("a/h"));
+  }));
+  EXPECT_EQ(3u, index->snapshot()->size());
+}
+
+TEST_F(TestTreeIndex, CoalescesStorms) {
+  MakeDir("a");
+  auto index = TreeIndex::Create(Path(dir_));
+  ASSERT_NE(nullptr, index);
+
+  // Creating and deleting the same names repeatedly leaves only a few paths to revalidate.
+  for (int i = 0; i < 50; ++i) {
+    MakeFile("a/f");
+    MakeFile("a/g");
+    ASSERT_EQ(0, unlink(Name("a/f").c_str()));
+  }
+  EXPECT_TRUE(PollUntil(index.get(), [](const TreeIndex::Snapshot &s) {
+    return s.contains(Path("a/g"));
+  }));
+  EXPECT_GE(index->stats().events, 101u);
+  EXPECT_LT(index->stats().revalidated, index->stats().events);
+  EXPECT_FALSE(index->snapshot()->contains(Path("a/f")));
+}
+
+TEST_F(TestTreeIndex, BatchLimit) {
+  TreeIndexOptions options;
+  options.max_batch_events = 10;
+  options.coalesce_window = std::chrono::milliseconds(200);
+  auto index = TreeIndex::Create(Path(dir_), options);
+  ASSERT_NE(nullptr, index);
+
+  for (int i = 0; i < 100; ++i) {
+    MakeFile("f" + std::to_string(i));
+  }
+  // The first batch is closed long before the coalescing window ends or the queue is drained.
+  ASSERT_TRUE(index->Poll(std::chrono::milliseconds(1000)).has_value());
+  EXPECT_EQ(1u, index->stats().batches);
+  EXPECT_LT(index->stats().events, 50u);
+  EXPECT_TRUE(PollUntil(index.get(), [](const TreeIndex::Snapshot &s) { return s.size() == 100; }));
+}
+
+TEST_F(TestTreeIndex, Rescan) {
+  MakeDir("a");
+  MakeDir("b");
+  MakeFile("b/f");
+  auto index = TreeIndex::Create(Path(dir_));
+  ASSERT_NE(nullptr, index);
+
+  // Applied without reading any events, as after an overflow.
+  MakeDir("a/c");
+  MakeFile("a/c/f");
+  ASSERT_EQ(0, unlink(Name("b/f").c_str()));
+  EXPECT_EQ(3u, index->Rescan());
+  auto snapshot = index->snapshot();
+  EXPECT_TRUE(snapshot->contains(Path("a/c/f")));
+  EXPECT_FALSE(snapshot->contains(Path("b/f")));
+  EXPECT_EQ(4u, snapshot->size());
+  EXPECT_GE(index->stats().rescanned_dirs, 2u);
+
+  // The queued events then change nothing.
+  while (index->Poll(std::chrono::milliseconds(0)).value_or(0) > 0) {
+  }
+  EXPECT_EQ(4u, index->snapshot()->size());
+}
+
+TEST_F(TestTreeIndex, UnchangedRescan) {
+  MakeDir("a");
+  MakeFile("a/f");
+  auto index = TreeIndex::Create(Path(dir_));
+  ASSERT_NE(nullptr, index);
+  const auto before = index->snapshot();
+
+  // The directories were modified too recently to trust their mtimes, so they're re-read, but as
+  // nothing differs no snapshot is published.
+  EXPECT_EQ(0u, index->Rescan());
+  EXPECT_GE(index->stats().rescanned_dirs, 2u);
+  EXPECT_EQ(&*before, &*index->snapshot());
+}
+
+TEST_F(TestTreeIndex, HeldSnapshots) {
+  auto index = TreeIndex::Create(Path(dir_));
+  ASSERT_NE(nullptr, index);
+
+  // Each reference keeps the snapshot it was taken from, while the ones replaced in between and
+  // no longer referenced are freed.
+  std::vector<TreeIndex::SnapshotRef> held;
+  for (uint64_t i = 0; i < 10; ++i) {
+    held.push_back(index->snapshot());
+    MakeFile("f" + std::to_string(i));
+    ASSERT_TRUE(PollUntil(index.get(),
+                          [i](const TreeIndex::Snapshot &s) { return s.size() == i + 1; }));
+    auto dropped = index->snapshot();
+  }
+  for (uint64_t i = 0; i < held.size(); ++i) {
+    EXPECT_EQ(i, held[i]->size());
+  }
+  held.erase(held.begin(), held.begin() + 5);
+  EXPECT_EQ(5u, held.front()->size());
+  MakeFile("g");
+  EXPECT_TRUE(PollUntil(index.get(), [](const TreeIndex::Snapshot &s) { return s.size() == 11; }));
+  EXPECT_EQ(9u, held.back()->size());
+}
+
+TEST_F(TestTreeIndex, ConcurrentReaders) {
+  MakeDir("a");
+  auto index = TreeIndex::Create(Path(dir_));
+  ASSERT_NE(nullptr, index);
+
+  std::atomic<bool> done(false);
+  std::thread reader([&index, &done] {
+    while (!done.load()) {
+      auto snapshot = index->snapshot();
+      // Every published snapshot is consistent: the size matches the entries.
+      const auto children = snapshot->children(Path("a"));
+      ASSERT_TRUE(children.has_value());
+      ASSERT_EQ(snapshot->size(), 1 + children->size());
+    }
+  });
+  for (int i = 0; i < 100; ++i) {
+    MakeFile("a/f" + std::to_string(i));
+    index->Poll(std::chrono::milliseconds(0));
+  }
+  EXPECT_TRUE(PollUntil(index.get(), [](const TreeIndex::Snapshot &s) { return s.size() == 101; }));
+  done.store(true);
+  reader.join();
+}
+
+}  // anonymous namespace
+}  // namespace spin_2_fs
+// vim: sw=2:sts=2:tw=100:et:cindent:cinoptions=l1,g1,h1,N-s,E-s,i2s,+2s,(0,w1,W2s